@@ -0,0 +1,118 @@
+/**
+ * @file DirIndex.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Name lookup index for one directory, kept in caller supplied RAM.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <DirIndex.h>
+
+DirIndex::DirIndex(dir_index_entry_t *entries, uint16_t capacity) :
+    entries(entries), capacity(capacity)
+{
+    cluster = 0;
+    next = nullptr;
+    clear();
+}
+
+void DirIndex::clear()
+{
+    count = 0;
+    state = State::EMPTY;
+}
+
+DirIndex::State DirIndex::get_state()
+{
+    return state;
+}
+
+void DirIndex::set_state(State state)
+{
+    this->state = state;
+    if (state != State::BUILT)
+        count = 0;
+}
+
+uint16_t DirIndex::find(uint16_t hash, uint16_t from)
+{
+    for (uint16_t i = from; i < count; i++) {
+        if (entries[i].hash == hash)
+            return i;
+    }
+    return NONE;
+}
+
+dir_index_entry_t* DirIndex::get(uint16_t slot)
+{
+    return &entries[slot];
+}
+
+bool DirIndex::add(uint16_t hash, uint32_t block, uint8_t index)
+{
+    dir_index_entry_t *e;
+    if (count < capacity) {
+        e = &entries[count++];
+    } else if (hash == FREE) {
+        // free slots are only a hint
+        return false;
+    } else {
+        // a name replaces the last free slot, earlier ones keep their order
+        uint16_t i = count;
+        while (i && entries[i - 1].hash != FREE)
+            i--;
+        if (!i) {
+            set_state(State::OVERFLOW);
+            return false;
+        }
+        e = &entries[i - 1];
+    }
+    e->hash = hash;
+    e->block = block;
+    e->index = index;
+    return true;
+}
+
+void DirIndex::remove(uint32_t block, uint8_t index)
+{
+    for (uint16_t i = 0; i < count; i++) {
+        if (entries[i].block == block && entries[i].index == index) {
+            entries[i].hash = FREE;
+            return;
+        }
+    }
+}
+
+uint16_t DirIndex::hash(const uint8_t *name)
+{
+    // FNV-1a folded to 16 bits
+    uint32_t h = 2166136261UL;
+    for (uint8_t i = 0; i < 11; i++) {
+        h ^= name[i];
+        h *= 16777619UL;
+    }
+    uint16_t r = (h >> 16) ^ (h & 0XFFFF);
+
+    // zero marks a free slot
+    return r == FREE ? 1 : r;
+}
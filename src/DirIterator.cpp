@@ -0,0 +1,118 @@
+/**
+ * @file DirIterator.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Directory walker handing out raw entries with a resumable position.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <DirIterator.h>
+
+DirIterator::DirIterator(File &dir, uint8_t options) :
+    dir(&dir), options(options)
+{
+    cookie = 0;
+    end = false;
+}
+
+/**
+ * Returns the next entry matching the options, or nullptr at the end of
+ * the directory or on error. The entry points into the block cache and is
+ * only valid until the volume is accessed again.
+ */
+dir_t* DirIterator::next()
+{
+    end = false;
+
+    if(!(options & (File::LS_FILE | File::LS_FOLDER)))
+        return nullptr;
+
+    // opens in the same directory may have moved it
+    if(dir->get_current_position() != cookie && !dir->seek_set(cookie))
+        return nullptr;
+
+    dir_t* p;
+    while((p = dir->read_dir_cache())){
+        // done if past last used entry, stay on it for later entries
+        if(p->name[0] == DIR_NAME_FREE){
+            end = true;
+            return nullptr;
+        }
+        cookie = dir->get_current_position();
+
+        if(p->name[0] == DIR_NAME_DELETED || p->name[0] == '.' || p->name[0] == 0x80)
+            continue;
+
+        // long name parts and the volume label
+        if(!DIR_IS_FILE_OR_SUBDIR(p))
+            continue;
+
+        if(DIR_IS_SUBDIR(p) && !(options & File::LS_FOLDER))
+            continue;
+
+        if(DIR_IS_FILE(p) && !(options & File::LS_FILE))
+            continue;
+
+        break;
+    }
+
+    // read error unless the end of the chain was reached
+    if(!p)
+        end = dir->get_current_position() >= dir->get_file_size();
+    return p;
+}
+
+/** Tells whether the last next() returned nullptr at the end of the directory. */
+bool DirIterator::is_end()
+{
+    return end;
+}
+
+void DirIterator::rewind()
+{
+    cookie = 0;
+}
+
+/**
+ * Position after the last entry returned. Handing it to seek() later
+ * continues the listing from there without rescanning the directory.
+ */
+uint32_t DirIterator::get_cookie()
+{
+    return cookie;
+}
+
+bool DirIterator::seek(uint32_t cookie)
+{
+    // must be the start of an entry
+    if(cookie & 0X1F)
+        return false;
+
+    this->cookie = cookie;
+    return true;
+}
+
+void DirIterator::get_name(const dir_t *p, char *buffer)
+{
+    dir->fill_name(p, buffer, 0);
+}
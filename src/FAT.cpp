@@ -27,15 +27,37 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
 #include <FAT.h>
 
-FAT::FAT(SDCard *dev)
+FAT::FAT(BlockDevice *dev)
 {
     this->dev = dev;
-    cache_block_no = 0XFFFFFFFF;
-    cache_dirty = false;
-    cache_mirror_block = 0;
+    for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+        cache[i].block_no = 0XFFFFFFFF;
+        cache[i].mirror_block = 0;
+        cache[i].dirty = false;
+        cache[i].pins = 0;
+        cache_lru[i] = i;
+    }
+    current = &cache[0];
+#ifdef FAT_CACHE_STATS
+    cache_hits = cache_misses = 0;
+#endif
     alloc_search_start = 2;
+    au_first_cluster = 0;
+    au_clusters = 0;
+    au_full = false;
+    discard = false;
+    deferred_mirror = false;
+    mirror_base = 0;
+    mirror_map = 0;
+    fsinfo_block = 0;
+    free_count = FSINFO_UNKNOWN;
+    fsinfo_dirty = false;
+    boot_block = 0;
+    root_size = 0;
+    dir_indexes = nullptr;
 }
 
 bool FAT::mount()
@@ -43,10 +65,12 @@ bool FAT::mount()
     uint32_t start_block = 0;
     uint8_t part = 1; // For now only first partition
 
+    mount_reset();
+
     if (!cache_raw_block(start_block, CACHE_FOR_READ))
         return false;
 
-    part_t* p = &buffer.mbr.part[part-1];
+    part_t* p = &current->buffer.mbr.part[part-1];
     if ((p->boot & 0X7F) !=0  ||
         p->totalSectors < 100 ||
         p->firstSector == 0) {
@@ -54,11 +78,12 @@ bool FAT::mount()
         return false;
     }
     start_block = p->firstSector;
+    boot_block = start_block;
 
     if (!cache_raw_block(start_block, CACHE_FOR_READ))
         return false;
 
-    bpb_t* bpb = &buffer.fbs.bpb;
+    bpb_t* bpb = &current->buffer.fbs.bpb;
     if (bpb->bytesPerSector != 512 ||
         bpb->fatCount == 0 ||
         bpb->reservedSectorCount == 0 ||
@@ -109,24 +134,405 @@ bool FAT::mount()
     } else {
         root_dir_start = bpb->fat32RootCluster;
         fat_type = Type::F32;
+
+        // FSINFO holds the free count and next free hints
+        if (bpb->fat32FSInfo)
+            fsinfo_block = start_block + bpb->fat32FSInfo;
+    }
+
+    // single type builds have no code for the other type
+#if defined(FAT_ONLY_FAT16)
+    if (fat_type != Type::F16)
+        return false;
+#elif defined(FAT_ONLY_FAT32)
+    if (fat_type != Type::F32)
+        return false;
+#endif
+
+    free_map_init();
+
+    if (fsinfo_block && !read_fsinfo())
+        return false;
+
+    return true;
+}
+
+void FAT::mount_reset()
+{
+    mirror_map = 0;
+    alloc_search_start = 2;
+    au_full = false;
+    fsinfo_block = 0;
+    free_count = FSINFO_UNKNOWN;
+    fsinfo_dirty = false;
+    root_size = 0;
+#if FAT_DENTRY_SLOTS
+    for (uint8_t i = 0; i < FAT_DENTRY_SLOTS; i++)
+        dentries[i].cluster = 0;
+#endif
+    dir_indexes = nullptr;
+}
+
+dentry_t* FAT::dentry_find(uint32_t parent, const uint8_t *name)
+{
+#if FAT_DENTRY_SLOTS
+    for (uint8_t i = 0; i < FAT_DENTRY_SLOTS; i++) {
+        if (!dentries[i].cluster)
+            break;
+        if (dentries[i].parent != parent || memcmp(dentries[i].name, name, 11))
+            continue;
+
+        // move to front
+        dentry_t hit = dentries[i];
+        memmove(&dentries[1], &dentries[0], i * sizeof(dentry_t));
+        dentries[0] = hit;
+        return &dentries[0];
+    }
+#endif
+    return nullptr;
+}
+
+void FAT::dentry_add(const dentry_t *dentry)
+{
+#if FAT_DENTRY_SLOTS
+    // least recently used falls off the end
+    memmove(&dentries[1], &dentries[0], (FAT_DENTRY_SLOTS - 1) * sizeof(dentry_t));
+    dentries[0] = *dentry;
+#endif
+}
+
+void FAT::add_dir_index(DirIndex *index, uint32_t cluster)
+{
+    remove_dir_index(index);
+    index->clear();
+    index->cluster = cluster;
+    index->next = dir_indexes;
+    dir_indexes = index;
+}
+
+void FAT::remove_dir_index(DirIndex *index)
+{
+    for (DirIndex **p = &dir_indexes; *p; p = &(*p)->next) {
+        if (*p == index) {
+            *p = index->next;
+            return;
+        }
+    }
+}
+
+DirIndex* FAT::find_dir_index(uint32_t cluster)
+{
+    for (DirIndex *index = dir_indexes; index; index = index->next) {
+        if (index->cluster == cluster)
+            return index;
+    }
+    return nullptr;
+}
+
+void FAT::dir_index_drop(uint32_t block, uint8_t index)
+{
+    // blocks belong to one directory, only its index holds the entry
+    for (DirIndex *d = dir_indexes; d; d = d->next)
+        d->remove(block, index);
+}
+
+bool FAT::mount(const fat_snapshot_t *snap)
+{
+    // not taken or damaged - full mount
+    if (snap->magic != FAT_SNAPSHOT_MAGIC || snapshot_sum(snap) != 0XFF)
+        return mount();
+
+    mount_reset();
+
+    // one read of the boot sector tells if it is still the same volume
+    boot_block = snap->boot_block;
+    if (!cache_raw_block(boot_block, CACHE_FOR_READ))
+        return false;
+
+    bpb_t *bpb = &current->buffer.fbs.bpb;
+    uint32_t total_blocks = bpb->totalSectors16 ?
+                            bpb->totalSectors16 : bpb->totalSectors32;
+    uint32_t fat_blocks = bpb->sectorsPerFat16 ?
+                          bpb->sectorsPerFat16 : bpb->sectorsPerFat32;
+    fat_type = (Type)snap->fat_type;
+    if (bpb->bytesPerSector != 512 ||
+        total_blocks != snap->total_blocks ||
+        fat_blocks != snap->blocks_per_fat ||
+        get_serial() != snap->serial) {
+        // card was changed or formatted
+        return mount();
     }
 
+    fat_count = snap->fat_count;
+    blocks_per_cluster = snap->blocks_per_cluster;
+    cluster_size_shift = snap->cluster_size_shift;
+    blocks_per_fat = snap->blocks_per_fat;
+    fat_start_block = snap->fat_start_block;
+    root_dir_entry_cnt = snap->root_dir_entry_cnt;
+    root_dir_start = snap->root_dir_start;
+    data_start_block = snap->data_start_block;
+    cluster_count = snap->cluster_count;
+    fsinfo_block = snap->fsinfo_block;
+
+    free_map_init();
+
+    // free count and next free change with every write, FSINFO has them
+    if (fsinfo_block && !read_fsinfo())
+        return false;
+
+    return true;
+}
+
+bool FAT::get_snapshot(fat_snapshot_t *snap)
+{
+    if (!cache_raw_block(boot_block, CACHE_FOR_READ))
+        return false;
+
+    snap->magic = FAT_SNAPSHOT_MAGIC;
+    snap->serial = get_serial();
+    snap->boot_block = boot_block;
+    bpb_t *bpb = &current->buffer.fbs.bpb;
+    snap->total_blocks = bpb->totalSectors16 ?
+                         bpb->totalSectors16 : bpb->totalSectors32;
+    snap->fat_count = fat_count;
+    snap->blocks_per_cluster = blocks_per_cluster;
+    snap->cluster_size_shift = cluster_size_shift;
+    snap->fat_type = (uint8_t)fat_type;
+    snap->blocks_per_fat = blocks_per_fat;
+    snap->fat_start_block = fat_start_block;
+    snap->root_dir_entry_cnt = root_dir_entry_cnt;
+    snap->root_dir_start = root_dir_start;
+    snap->data_start_block = data_start_block;
+    snap->cluster_count = cluster_count;
+    snap->fsinfo_block = fsinfo_block;
+    snap->check = 0;
+    snap->check = 0XFF - snapshot_sum(snap);
+
     return true;
 }
 
+uint32_t FAT::get_serial()
+{
+    // FAT16 extended boot record is where FAT32 BPB fields start
+    uint8_t *p = current->buffer.data + (is_fat16() ? 39 : 67);
+    uint32_t serial;
+    memcpy(&serial, p, sizeof(serial));
+    return serial;
+}
+
+uint8_t FAT::snapshot_sum(const fat_snapshot_t *snap)
+{
+    const uint8_t *p = (const uint8_t*)snap;
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < sizeof(fat_snapshot_t); i++)
+        sum += p[i];
+    return sum;
+}
+
+bool FAT::get_root_size(uint32_t *size)
+{
+    // FAT32 root is a cluster chain - walk it once
+    if (!root_size && !get_chain_size(root_dir_start, &root_size))
+        return false;
+    *size = root_size;
+    return true;
+}
+
+void FAT::set_root_size(uint32_t size)
+{
+    root_size = size;
+}
+
+bool FAT::read_fsinfo()
+{
+    if (!cache_raw_block(fsinfo_block, CACHE_FOR_READ))
+        return false;
+
+    fsinfo_t *fsi = &current->buffer.fsinfo;
+    if (fsi->leadSignature != FSINFO_LEAD_SIG ||
+        fsi->structSignature != FSINFO_STRUCT_SIG) {
+        // not valid FSINFO - don't use or update it
+        fsinfo_block = 0;
+        return true;
+    }
+
+    // hints may be stale or garbage - keep only plausible values
+    if (fsi->freeCount <= cluster_count)
+        free_count = fsi->freeCount;
+    if (fsi->nextFree >= 2 && fsi->nextFree <= cluster_count + 1)
+        alloc_search_start = fsi->nextFree;
+
+    return true;
+}
+
+bool FAT::write_fsinfo()
+{
+    if (!fsinfo_block || !fsinfo_dirty)
+        return true;
+
+    if (!cache_raw_block(fsinfo_block, CACHE_FOR_WRITE))
+        return false;
+
+    fsinfo_t *fsi = &current->buffer.fsinfo;
+    fsi->freeCount = free_count;
+    fsi->nextFree = alloc_search_start;
+    fsinfo_dirty = false;
+
+    return true;
+}
+
+int32_t FAT::free_clusters()
+{
+    if (free_count != FSINFO_UNKNOWN)
+        return free_count;
+
+    // last cluster of FAT
+    uint32_t fatEnd = cluster_count + 1;
+
+    // clusters of one free_map group minus one
+    uint32_t groupMask = (1UL << free_group_shift) - 1;
+    bool groupFree = false;
+
+    // count free entries a FAT sector at a time
+    uint32_t count = 0;
+    uint32_t cluster = 0;
+    for (uint32_t lba = fat_start_block; cluster <= fatEnd; lba++) {
+        if (!cache_raw_block(lba, CACHE_FOR_READ))
+            return -1;
+
+        uint16_t n = 1 << fat_entry_shift();
+        for (uint16_t i = 0; i < n && cluster <= fatEnd; i++, cluster++) {
+            if (fat_entry(cluster) == 0 && cluster >= 2) {
+                count++;
+                groupFree = true;
+            }
+
+            // summary learns full groups for free
+            if ((cluster & groupMask) == groupMask) {
+                if (!groupFree)
+                    free_map_mark(cluster, false);
+                groupFree = false;
+            }
+        }
+    }
+
+    free_count = count;
+    fsinfo_dirty = true;
+
+    return count;
+}
+
 bool FAT::cache_raw_block(uint32_t block_no, uint8_t action)
 {
-    if(cache_block_no != block_no){
-        if(!flush_cache())
-            return false;
-        if(!dev->read_block(block_no, buffer.data))
+    // the current slot is always the most recently used
+    if (current->block_no != block_no) {
+        uint8_t i = 0;
+        while (i < FAT_CACHE_SLOTS && cache[i].block_no != block_no)
+            i++;
+
+        if (i == FAT_CACHE_SLOTS) {
+            // miss - reuse least recently used slot that is not pinned
+            uint8_t n = FAT_CACHE_SLOTS;
+            do {
+                if (!n)
+                    return false;
+                i = cache_lru[--n];
+            } while (cache[i].pins);
+
+            if (!cache_write_back(&cache[i]))
+                return false;
+
+            if (!(action & CACHE_OPTION_NO_READ)) {
+                if (!dev->read_block(block_no, cache[i].buffer.data)) {
+                    cache[i].block_no = 0XFFFFFFFF;
+                    return false;
+                }
+            }
+            cache[i].block_no = block_no;
+#ifdef FAT_CACHE_STATS
+            cache_misses++;
+        } else {
+            cache_hits++;
+#endif
+        }
+        current = &cache[i];
+        cache_touch(i);
+#ifdef FAT_CACHE_STATS
+    } else {
+        cache_hits++;
+#endif
+    }
+    if (action & CACHE_FOR_WRITE)
+        current->dirty = true;
+    return true;
+}
+
+void FAT::cache_touch(uint8_t index)
+{
+    // move slot to the front of the lru list
+    uint8_t i = 0;
+    while (cache_lru[i] != index)
+        i++;
+    for (; i; i--)
+        cache_lru[i] = cache_lru[i - 1];
+    cache_lru[0] = index;
+}
+
+bool FAT::cache_write_back(cache_slot_t *slot)
+{
+    if (slot->dirty) {
+        if (!dev->write_block(slot->block_no, slot->buffer.data))
             return false;
-        cache_block_no = block_no;
+
+        // mirror FAT tables
+        if (slot->mirror_block) {
+            if (!dev->write_block(slot->mirror_block, slot->buffer.data))
+                return false;
+
+            slot->mirror_block = 0;
+        }
+        slot->dirty = false;
     }
-    cache_dirty |= action;
     return true;
 }
 
+bool FAT::is_cached(uint32_t block_no)
+{
+    for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+        if (cache[i].block_no == block_no)
+            return true;
+    }
+    return false;
+}
+
+bool FAT::pin_block(uint32_t block_no, uint8_t action)
+{
+    if (!cache_raw_block(block_no, action))
+        return false;
+    current->pins++;
+    return true;
+}
+
+void FAT::unpin_block(uint32_t block_no)
+{
+    for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+        if (cache[i].block_no == block_no && cache[i].pins)
+            cache[i].pins--;
+    }
+}
+
+#ifdef FAT_CACHE_STATS
+uint32_t FAT::get_cache_hits()
+{
+    return cache_hits;
+}
+
+uint32_t FAT::get_cache_misses()
+{
+    return cache_misses;
+}
+#endif
+
 FAT::Type FAT::get_type()
 {
     return fat_type;
@@ -156,41 +562,167 @@ uint32_t FAT::get_root_start()
 
 bool FAT::get_chain_size(uint32_t cluster, uint32_t *size)
 {
-    uint32_t sz = 0;
+    uint32_t count = 0;
     do {
-        if(!get_fat(cluster, &cluster))
+        if(!follow_chain(&cluster, &count))
             return false;
-
-        sz += 512UL << cluster_size_shift;
     } while(!is_eoc(cluster));
-    *size = sz;
+    *size = count << (cluster_size_shift + 9);
     return true;
 }
 
 bool FAT::get_fat(uint32_t cluster, uint32_t *value)
 {
+    if (!cache_fat(cluster, CACHE_FOR_READ))
+        return false;
+
+    *value = fat_entry(cluster);
+    return true;
+}
+
+bool FAT::cache_fat(uint32_t cluster, uint8_t action)
+{
+    // error if not in FAT
     if (cluster > (cluster_count + 1))
         return false;
 
-    uint32_t lba = fat_start_block;
-    lba += fat_type == Type::F16 ? cluster >> 8 : cluster >> 7;
+    uint32_t sector = cluster >> fat_entry_shift();
 
-    if (lba != cache_block_no) {
-        if (!cache_raw_block(lba, CACHE_FOR_READ))
+    if (action & CACHE_FOR_WRITE) {
+        // error if reserved cluster
+        if (cluster < 2)
+            return false;
+
+        // mirror second FAT - may evict, so before the block is cached
+        if (fat_count > 1 && deferred_mirror && !mirror_fat(sector))
             return false;
     }
 
-    if (fat_type == Type::F16)
-        *value = buffer.fat16[cluster & 0XFF];
+    if (!cache_raw_block(fat_start_block + sector, action))
+        return false;
+
+    if ((action & CACHE_FOR_WRITE) && fat_count > 1 && !deferred_mirror)
+        current->mirror_block = fat_start_block + sector + blocks_per_fat;
+
+    return true;
+}
+
+uint8_t FAT::fat_entry_shift()
+{
+    return is_fat16() ? 8 : 7;
+}
+
+uint32_t FAT::fat_entry(uint32_t cluster)
+{
+    if (is_fat16())
+        return current->buffer.fat16[cluster & 0XFF];
+    return current->buffer.fat32[cluster & 0X7F] & FAT32MASK;
+}
+
+void FAT::store_fat(uint32_t cluster, uint32_t value)
+{
+    uint32_t old = fat_entry(cluster);
+    if (is_fat16())
+        current->buffer.fat16[cluster & 0XFF] = value;
     else
-        *value = buffer.fat32[cluster & 0X7F] & FAT32MASK;
-  
+        current->buffer.fat32[cluster & 0X7F] = value;
+
+    // track free count when a cluster is allocated or freed
+    if ((old == 0) != (value == 0)) {
+        if (free_count != FSINFO_UNKNOWN)
+            free_count += value == 0 ? 1 : -1;
+        fsinfo_dirty = true;
+    }
+    if (value == 0) {
+        free_map_mark(cluster, true);
+        au_full = false;
+    }
+}
+
+uint32_t FAT::find_free(uint32_t first, uint32_t last)
+{
+    if (is_fat16()) {
+        uint16_t *p = &current->buffer.fat16[first & 0XFF];
+        for (uint32_t c = first; c <= last; c++, p++) {
+            if (!*p)
+                return c;
+        }
+    } else {
+        uint32_t *p = &current->buffer.fat32[first & 0X7F];
+        for (uint32_t c = first; c <= last; c++, p++) {
+            if (!(*p & FAT32MASK))
+                return c;
+        }
+    }
+    return 0;
+}
+
+uint32_t FAT::find_free_run(uint32_t first, uint32_t last)
+{
+    if (is_fat16()) {
+        uint16_t *p = &current->buffer.fat16[first & 0XFF];
+        for (uint32_t c = first; c <= last; c++, p++) {
+            if (*p)
+                return c - 1;
+        }
+    } else {
+        uint32_t *p = &current->buffer.fat32[first & 0X7F];
+        for (uint32_t c = first; c <= last; c++, p++) {
+            if (*p & FAT32MASK)
+                return c - 1;
+        }
+    }
+    return last;
+}
+
+bool FAT::follow_chain(uint32_t *cluster, uint32_t *count)
+{
+    if (!cache_fat(*cluster, CACHE_FOR_READ))
+        return false;
+
+    // bounded so a looped chain still returns
+    uint32_t sector = *cluster >> fat_entry_shift();
+    for (uint16_t n = 0; n < 256; n++) {
+        uint32_t next = fat_entry(*cluster);
+        (*count)++;
+        *cluster = next;
+        if (next < 2 || (next >> fat_entry_shift()) != sector || is_eoc(next))
+            break;
+    }
     return true;
 }
 
+bool FAT::get_chain_end(uint32_t *cluster, uint32_t *count, bool *contiguous)
+{
+    uint32_t n = 0;
+    *contiguous = true;
+    for (;;) {
+        if (!cache_fat(*cluster, CACHE_FOR_READ))
+            return false;
+
+        // follow the chain inside the cached FAT sector
+        uint32_t sector = *cluster >> fat_entry_shift();
+        uint32_t next;
+        do {
+            next = fat_entry(*cluster);
+            n++;
+            if (is_eoc(next)) {
+                *count = n;
+                return true;
+            }
+            // free or looped chain
+            if (next < 2 || n > cluster_count)
+                return false;
+            if (next != *cluster + 1)
+                *contiguous = false;
+            *cluster = next;
+        } while ((next >> fat_entry_shift()) == sector);
+    }
+}
+
 bool FAT::is_eoc(uint32_t cluster)
 {
-    return cluster >= (fat_type == Type::F16 ? FAT16EOC_MIN : FAT32EOC_MIN);
+    return cluster >= (is_fat16() ? FAT16EOC_MIN : FAT32EOC_MIN);
 }
 
 
@@ -208,7 +740,7 @@ uint32_t FAT::get_start_block(uint32_t cluster)
 
 uint32_t FAT::get_cache_block_no()
 {
-    return cache_block_no;
+    return current->block_no;
 }
 
 bool FAT::read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *buffer)
@@ -216,30 +748,91 @@ bool FAT::read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *bu
     return dev->read_data(block, offset, count, buffer);
 }
 
+bool FAT::read_blocks(uint32_t block, uint16_t count, uint8_t *buffer)
+{
+    // the card must hold the latest data of cached blocks in range
+    for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+        if (cache[i].block_no >= block && cache[i].block_no < block + count) {
+            if (!cache_write_back(&cache[i]))
+                return false;
+        }
+    }
+    return dev->read_blocks(block, count, buffer);
+}
+
 uint8_t* FAT::get_buffer_data_ptr()
 {
-    return buffer.data;
+    return current->buffer.data;
 }
 
 dir_t* FAT::get_buffer_dir_ptr()
 {
-    return buffer.dir;
+    return current->buffer.dir;
 }
 
 bool FAT::flush_cache()
 {
-    if(cache_dirty){
-        if (!dev->write_block(cache_block_no, buffer.data)) 
+    // close any multiple block write before touching the card
+    if (!dev->write_stop())
+        return false;
+
+    for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+        if (!cache_write_back(&cache[i]))
             return false;
+    }
+    return true;
+}
 
-        // mirror FAT tables
-        if (cache_mirror_block) {
-            if (!dev->write_block(cache_mirror_block, buffer.data)) 
+bool FAT::sync()
+{
+    if (!flush_mirror() || !write_fsinfo())
+        return false;
+
+    // device may still hold deferred writes after the cache is flushed
+    return flush_cache() && dev->sync();
+}
+
+bool FAT::unmount()
+{
+    return sync();
+}
+
+bool FAT::set_deferred_mirror(bool enable)
+{
+    if (!enable && !flush_mirror())
+        return false;
+    deferred_mirror = enable;
+    return true;
+}
+
+bool FAT::mirror_fat(uint32_t sector)
+{
+    // window moves - copy what it holds first
+    if (mirror_map && (sector & ~31UL) != mirror_base) {
+        if (!flush_mirror())
+            return false;
+    }
+    mirror_base = sector & ~31UL;
+    mirror_map |= 1UL << (sector & 31);
+    return true;
+}
+
+bool FAT::flush_mirror()
+{
+    for (uint8_t i = 0; mirror_map; i++) {
+        if (!(mirror_map & (1UL << i)))
+            continue;
+
+        // copy latest contents of the primary sector to the other FATs,
+        // primary goes first so no copy is ever newer than it
+        uint32_t lba = fat_start_block + mirror_base + i;
+        if (!cache_raw_block(lba, CACHE_FOR_READ) || !cache_write_back(current))
+            return false;
+        for (uint8_t n = 1; n < fat_count; n++) {
+            if (!dev->write_block(lba + n * blocks_per_fat, current->buffer.data))
                 return false;
-            
-            cache_mirror_block = 0;
         }
-        cache_dirty = false;
+        mirror_map &= ~(1UL << i);
     }
     return true;
 }
@@ -251,56 +844,98 @@ uint8_t FAT::get_cluster_size_shift()
 
 bool FAT::free_chain(uint32_t cluster)
 {
-    alloc_search_start = 2;
+    // run of contiguous clusters to discard
+    uint32_t run = cluster;
 
     do {
-        uint32_t next;
-        if(!get_fat(cluster, &next))
+        if(!cache_fat(cluster, CACHE_FOR_WRITE))
             return false;
 
-        if(!put_fat(cluster, 0))
-            return false;
+        // free the part of the chain inside this FAT sector
+        uint32_t sector = cluster >> fat_entry_shift();
+        do {
+            uint32_t next = fat_entry(cluster);
+            store_fat(cluster, 0);
+
+            // first freed cluster is the likely place for the next allocation
+            if(cluster < alloc_search_start)
+                alloc_search_start = cluster;
+
+            if(discard && next != cluster + 1){
+                if(!discard_clusters(run, cluster))
+                    return false;
+                run = next;
 
-        cluster = next;
+                // the FAT sector may have been written back, cache it for write again
+                cluster = next;
+                break;
+            }
+
+            cluster = next;
+        } while(cluster >= 2 && (cluster >> fat_entry_shift()) == sector && !is_eoc(cluster));
     } while(!is_eoc(cluster));
 
     return true;
 }
 
-bool FAT::put_fat(uint32_t cluster, uint32_t value)
+void FAT::set_discard(bool enable)
 {
-    // error if reserved cluster
-    if (cluster < 2)
-        return false;
+    discard = enable;
+}
 
-    // error if not in FAT
-    if (cluster > (cluster_count + 1))
+bool FAT::discard_clusters(uint32_t first, uint32_t last)
+{
+    uint32_t first_block = get_start_block(first);
+    uint32_t end_block = get_start_block(last) + blocks_per_cluster;
+
+    // only the whole erase sectors inside the run can be erased
+    uint16_t erase_size = dev->get_erase_size();
+    first_block += (erase_size - first_block % erase_size) % erase_size;
+    end_block -= end_block % erase_size;
+    if (end_block <= first_block)
+        return true;
+
+    // freed FAT entries go to the device first, a power loss must not
+    // leave a chain that owns erased blocks
+    if (!flush_mirror() || !flush_cache())
         return false;
 
-    // calculate block address for entry
-    uint32_t lba = fat_start_block;
-    lba += fat_type == Type::F16 ? cluster >> 8 : cluster >> 7;
+    // discard is only a hint, the clusters are free either way
+    if (cache_invalidate(first_block, end_block - 1))
+        dev->erase(first_block, end_block - 1);
+    return true;
+}
 
-    if (lba != cache_block_no) {
-        if (!cache_raw_block(lba, CACHE_FOR_READ))
+bool FAT::cache_invalidate(uint32_t first_block, uint32_t last_block)
+{
+    // a pinned block is still in use, leave the whole range cached
+    for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+        if (cache[i].pins && cache[i].block_no >= first_block && cache[i].block_no <= last_block)
             return false;
     }
-    // store entry
-    if (fat_type == Type::F16) {
-        buffer.fat16[cluster & 0XFF] = value;
-    } else {
-        buffer.fat32[cluster & 0X7F] = value;
+
+    for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+        if (cache[i].block_no >= first_block && cache[i].block_no <= last_block) {
+            cache[i].block_no = 0XFFFFFFFF;
+            cache[i].mirror_block = 0;
+            cache[i].dirty = false;
+        }
     }
-    set_cache_dirty();
+    return true;
+}
+
+bool FAT::put_fat(uint32_t cluster, uint32_t value)
+{
+    if (!cache_fat(cluster, CACHE_FOR_WRITE))
+        return false;
 
-    // mirror second FAT
-    if (fat_count > 1) cache_mirror_block = lba + blocks_per_fat;
+    store_fat(cluster, value);
     return true;
 }
 
 void FAT::set_cache_dirty()
 {
-    cache_dirty |= CACHE_FOR_WRITE;
+    current->dirty = true;
 }
 
 bool FAT::put_eoc(uint32_t cluster)
@@ -336,8 +971,17 @@ bool FAT::alloc_contiguous(uint32_t count, uint32_t *current_cluster)
     // last cluster of FAT
     uint32_t fatEnd = cluster_count + 1;
 
-    // search the FAT for free clusters
-    for (uint32_t n = 0;; n++, endCluster++) {
+    // clusters of one free_map group minus one
+    uint32_t groupMask = (1UL << free_group_shift) - 1;
+
+    // FAT entries per sector minus one
+    uint32_t sectorMask = (1UL << fat_entry_shift()) - 1;
+
+    // no free cluster seen since the start of the current group
+    bool groupFull = false;
+
+    // search the FAT for free clusters a FAT sector at a time
+    for (uint32_t n = 0;;) {
         // can't find space checked all clusters
         if (n >= cluster_count)
             return false;
@@ -346,17 +990,66 @@ bool FAT::alloc_contiguous(uint32_t count, uint32_t *current_cluster)
         if (endCluster > fatEnd) {
             bgnCluster = endCluster = 2;
         }
-        uint32_t f;
-        if (!get_fat(endCluster, &f))
+
+        if ((endCluster & groupMask) == 0 || endCluster == 2) {
+            if (!free_map_test(endCluster)) {
+                // skip group known to be full
+                uint32_t next = (endCluster | groupMask) + 1;
+                n += next - endCluster;
+                endCluster = bgnCluster = next;
+                continue;
+            }
+            groupFull = true;
+        }
+
+        // last cluster to scan in this FAT sector
+        uint32_t last = endCluster | sectorMask;
+        if (last > fatEnd)
+            last = fatEnd;
+
+        if (!cache_fat(endCluster, CACHE_FOR_READ))
             return false;
 
-        if (f != 0) {
-            // cluster in use try next cluster as bgnCluster
-            bgnCluster = endCluster + 1;
-        } else if ((endCluster - bgnCluster + 1) == count) {
-            // done - found space
-            break;
+        // scan runs of free clusters within the cached sector
+        uint32_t first = endCluster;
+        while (endCluster <= last) {
+            if (bgnCluster == endCluster) {
+                // no free run yet - find its start
+                uint32_t c = find_free(endCluster, last);
+                if (!c) {
+                    endCluster = bgnCluster = last + 1;
+                    break;
+                }
+                endCluster = bgnCluster = c;
+            }
+            groupFull = false;
+
+            // extend the run, but not past the clusters needed
+            uint32_t limit = bgnCluster + count - 1;
+            if (limit > last)
+                limit = last;
+            uint32_t end = find_free_run(endCluster, limit);
+
+            if (end - bgnCluster + 1 == count) {
+                // done - found space
+                endCluster = end;
+                break;
+            }
+            if (end == last) {
+                // run may go on in the next FAT sector
+                endCluster = last + 1;
+            } else {
+                // cluster after the run is in use
+                endCluster = bgnCluster = end + 2;
+            }
         }
+        if (endCluster <= last)
+            break;
+
+        // remember group scanned from start without a free cluster
+        if (groupFull && (last & groupMask) == groupMask)
+            free_map_mark(last, false);
+        n += last - first + 1;
     }
     // mark end of chain
     if (!put_eoc(endCluster))
@@ -382,26 +1075,164 @@ bool FAT::alloc_contiguous(uint32_t count, uint32_t *current_cluster)
     return true;
 }
 
+bool FAT::set_alloc_unit(uint32_t blocks)
+{
+    au_clusters = 0;
+    au_full = false;
+    if (!blocks)
+        return true;
+
+    // an allocation unit must hold whole clusters
+    if (blocks & (blocks_per_cluster - 1))
+        return false;
+
+    // blocks from the first data block to the next AU boundary
+    uint32_t lead = data_start_block % blocks;
+    if (lead) lead = blocks - lead;
+
+    // clusters straddle AU boundaries if the volume is misaligned
+    if (lead & (blocks_per_cluster - 1))
+        return false;
+
+    au_first_cluster = 2 + (lead >> cluster_size_shift);
+    au_clusters = blocks >> cluster_size_shift;
+    return true;
+}
+
+bool FAT::alloc_aligned(uint32_t *current_cluster)
+{
+    // only new chains are aligned, none is while no AU was freed since the last search
+    if (!au_clusters || *current_cluster || au_full)
+        return alloc_contiguous(1, current_cluster);
+
+    // last cluster of FAT
+    uint32_t fatEnd = cluster_count + 1;
+
+    // first AU at or after the likely free area
+    uint32_t start = au_first_cluster;
+    if (alloc_search_start > start)
+        start += (alloc_search_start - start + au_clusters - 1) / au_clusters * au_clusters;
+
+    // wrap to first AU at end of FAT
+    if (start + au_clusters - 1 > fatEnd)
+        start = au_first_cluster;
+
+    // volume smaller than one AU
+    if (start + au_clusters - 1 > fatEnd)
+        return alloc_contiguous(1, current_cluster);
+
+    // FAT entries per sector minus one
+    uint32_t sectorMask = (1UL << fat_entry_shift()) - 1;
+
+    uint32_t au = start;
+    do {
+        // look for an AU with no cluster in use, none in a full group
+        uint32_t c = au;
+        uint32_t end = au + au_clusters - 1;
+        if (free_map_test(au)) {
+            // a FAT sector at a time, the AU may span several
+            while (c <= end) {
+                uint32_t last = c | sectorMask;
+                if (last > end)
+                    last = end;
+                if (!cache_fat(c, CACHE_FOR_READ))
+                    return false;
+                if (find_free_run(c, last) != last)
+                    break;
+                c = last + 1;
+            }
+        }
+        if (c > end) {
+            if (!put_eoc(au))
+                return false;
+            *current_cluster = au;
+            return true;
+        }
+        au += au_clusters;
+        if (au + au_clusters - 1 > fatEnd)
+            au = au_first_cluster;
+    } while (au != start);
+
+    // no free AU - any free cluster will do
+    au_full = true;
+    return alloc_contiguous(1, current_cluster);
+}
+
+void FAT::free_map_init()
+{
+    // smallest group size that lets free_map cover the whole FAT
+    free_group_shift = fat_entry_shift();
+    while (((cluster_count + 1) >> free_group_shift) >= 8UL * FAT_FREE_MAP_BYTES)
+        free_group_shift++;
+
+    // nothing known yet - every group may have free clusters
+    for (uint16_t i = 0; i < FAT_FREE_MAP_BYTES; i++)
+        free_map[i] = 0XFF;
+}
+
+bool FAT::free_map_test(uint32_t cluster)
+{
+    uint32_t group = cluster >> free_group_shift;
+    return free_map[group >> 3] & (1 << (group & 7));
+}
+
+void FAT::free_map_mark(uint32_t cluster, bool may_free)
+{
+    uint32_t group = cluster >> free_group_shift;
+    if (may_free)
+        free_map[group >> 3] |= 1 << (group & 7);
+    else
+        free_map[group >> 3] &= ~(1 << (group & 7));
+}
+
 bool FAT::cache_zero_block(uint32_t block_no)
 {
-    if (!flush_cache())
+    if (!cache_raw_block(block_no, CACHE_RESERVE_FOR_WRITE))
         return false;
 
     // loop take less flash than memset(cacheBuffer_.data, 0, 512);
     for (uint16_t i = 0; i < 512; i++) {
-        buffer.data[i] = 0;
+        current->buffer.data[i] = 0;
     }
-    cache_block_no = block_no;
-    set_cache_dirty();
     return true;
 }
 
-void FAT::set_cache_block_no(uint32_t block_no)
+bool FAT::zero_blocks(uint32_t first_block, uint32_t last_block)
 {
-    cache_block_no = block_no;
+    // erase is cheaper than writing zeros if the card erases to zero and
+    // takes the range, a rejected erase() would leave its error behind
+    uint16_t erase_size = dev->get_erase_size();
+    if (dev->get_erase_value() == 0 && !(first_block % erase_size) &&
+        !((last_block + 1) % erase_size) && cache_invalidate(first_block, last_block) &&
+        dev->erase(first_block, last_block))
+        return true;
+
+    for (uint32_t block = first_block; block <= last_block; block++) {
+        if (!cache_zero_block(block))
+            return false;
+    }
+    return true;
 }
 
 bool FAT::write_block(uint32_t block, const uint8_t *dst)
 {
     return dev->write_block(block, dst);
-}
\ No newline at end of file
+}
+
+bool FAT::write_multiple(uint32_t block, const uint8_t *src, uint16_t count, uint32_t owned)
+{
+    if (!dev->is_write_next(block)) {
+        // not a continuation of the open run - start a new one
+        if (!dev->write_stop())
+            return false;
+
+        if (count < 2)
+            return dev->write_block(block, src);
+
+        // pre-erase only blocks the caller owns, others may belong to another file
+        uint32_t erase = count < owned ? count : owned;
+        if (!dev->write_start(block, erase > 1 ? erase : 0))
+            return false;
+    }
+    return dev->write_next(src);
+}
@@ -28,12 +28,19 @@
  */
 
 #include <File.h>
+#include <DirIterator.h>
 
 File::File(FAT *fs) : fs(fs)
 {
     type = Type::CLOSED;
 }
 
+File::File(File f, const char *name) : File(f.fs)
+{
+    // stays closed if name is not found in f
+    open(f, name, O_READ);
+}
+
 bool File::open_root()
 {
     if(is_open())
@@ -46,8 +53,12 @@ bool File::open_root()
     } else if(fs->get_type() == FAT::Type::F32){
         type = Type::ROOT32;
         first_cluster = fs->get_root_start();
-        if(!fs->get_chain_size(first_cluster, &file_size))
-            return false;
+
+        // found when reading hits end of chain or get_file_size() asks
+        file_size = DIR_SIZE_UNKNOWN;
+        extent_reset();
+        contiguous = false;
+        contiguous_known = true;
     } else {
         // volume is not initialized or FAT12
         return false;
@@ -66,70 +77,45 @@ bool File::open_root()
     return true;
 }
 
+void File::set_index(DirIndex *index)
+{
+    DirIndex *old = fs->find_dir_index(first_cluster);
+    if(old)
+        fs->remove_dir_index(old);
+
+    // built by the next open() in this directory, through any handle
+    if(index)
+        fs->add_dir_index(index, first_cluster);
+}
+
 bool File::ls(char *buffer, uint8_t options)
 {
-    dir_t* p = nullptr;
     buffer[0]=0;
 
-    if(!(options & (LS_FILE | LS_FOLDER)))
+    // continue from the current position
+    DirIterator it(*this, options);
+    if(!it.seek(current_position))
         return false;
 
-    while((p = read_dir_cache())){
-        // done if past last used entry
-        if(p->name[0] == DIR_NAME_FREE)
-            return false; // Or true?
-        
-        if (p->name[0] == DIR_NAME_DELETED || p->name[0] == '.' || p->name[0] == 0x80)
-            continue;
-        
-        if(DIR_IS_SUBDIR(p) && !(options & LS_FOLDER))
-            continue;
-        
-        if(DIR_IS_FILE(p) && !(options & LS_FILE))
-            continue;
-        
-        break;
-    }
-
+    dir_t* p = it.next();
     return p ? fill_name(p, buffer, options) : false;
 }
 
 bool File::ls(char *buffer, uint8_t options, uint8_t index)
 {
-    dir_t* p = nullptr;
     buffer[0]=0;
 
-    if(!(options & (LS_FILE | LS_FOLDER)))
-        return false;
-
-    rewind();
-    for(int8_t i = 0; i <= index; i++){
-        p = read_dir_cache();
-        if(!p)
-            return false;
-
-        // done if past last used entry
-        if(p->name[0] == DIR_NAME_FREE)
-            return false; // Or true?
-        
-        if (p->name[0] == DIR_NAME_DELETED || p->name[0] == '.' || p->name[0] == 0x80){
-            i--;
-            continue;
-        }
-        if(DIR_IS_SUBDIR(p) && !(options & LS_FOLDER)){
-            i--;
-            continue;
-        }
-        if(DIR_IS_FILE(p) && !(options & LS_FILE)){
-            i--;
-            continue;
-        }
-    }
+    // rescans from the start, DirIterator keeps its place between calls
+    DirIterator it(*this, options);
+    dir_t* p;
+    do {
+        p = it.next();
+    } while(p && index--);
 
-    return fill_name(p, buffer, options);
+    return p ? fill_name(p, buffer, options) : false;
 }
 
-bool File::fill_name(dir_t* p, char* buffer, uint8_t options)
+bool File::fill_name(const dir_t* p, char* buffer, uint8_t options)
 {    
     uint8_t w = 0;
     for(uint8_t i = 0; i < 11; i++){
@@ -197,31 +183,28 @@ int16_t File::read(uint8_t *buffer, uint16_t size)
     while (toRead > 0) {
         uint32_t block;  // raw device block number
         uint16_t offset = current_position & 0X1FF;  // offset in block
-        if (type == Type::ROOT16) {
-            block = fs->get_root_start() + (current_position >> 9);
-        } else {
-            uint8_t blockOfCluster = fs->get_block(current_position);
-            if (offset == 0 && blockOfCluster == 0) {
-                // start of new cluster
-                if (current_position == 0) {
-                    // use first cluster in file
-                    current_cluster = first_cluster;
-                } else {
-                    // get next cluster from FAT
-                    if (!fs->get_fat(current_cluster, &current_cluster))
-                        return -1;
-                }
-            }
-            block = fs->get_start_block(current_cluster) + blockOfCluster;
+        uint8_t run;  // contiguous blocks from block to end of cluster
+        if (!current_block(&block, &run)) {
+            // end of directory chain sets its size
+            if (current_position == file_size)
+                break;
+            return -1;
         }
         uint16_t n = toRead;
 
         // amount to be read from current block
         if (n > (512 - offset)) n = 512 - offset;
 
-        // no buffering needed if n == 512 or user requests no buffering
-        if ((is_unbuffered_read() || n == 512) &&
-            block != fs->get_cache_block_no()) {
+        if (offset == 0 && toRead >= 1024 && run > 1) {
+            // several whole blocks in this cluster - stream them with CMD18
+            uint8_t count = toRead >> 9;
+            if (count > run) count = run;
+            if (!fs->read_blocks(block, count, buffer))
+                return -1;
+            n = (uint16_t)count << 9;
+            buffer += n;
+        } else if ((is_unbuffered_read() || n == 512) &&
+            !fs->is_cached(block)) {
             if (!fs->read_data(block, offset, n, buffer))
                 return -1;
             buffer += n;
@@ -237,7 +220,92 @@ int16_t File::read(uint8_t *buffer, uint16_t size)
         current_position += n;
         toRead -= n;
     }
-    return size;
+    return size - toRead;
+}
+
+/**
+ * Points data at the bytes from the current position to the end of their
+ * block, read into the block cache instead of a caller buffer. Returns
+ * how many there are, 0 at end of file or -1 on error. The data is valid
+ * until the next call into the volume; consume() moves past it.
+ */
+int16_t File::read_view(const uint8_t **data)
+{
+    // error if not open or write only
+    if(!is_open() || !(flags & O_READ))
+        return -1;
+
+    if(current_position >= file_size)
+        return 0;
+
+    // cluster is only advanced by consume()
+    uint32_t cluster = current_cluster;
+    uint32_t block;
+    uint8_t run;
+    bool ok = current_block(&block, &run);
+    current_cluster = cluster;
+    if(!ok)
+        return current_position == file_size ? 0 : -1;
+
+    if(!fs->cache_raw_block(block, FAT::CACHE_FOR_READ))
+        return -1;
+
+    uint16_t offset = current_position & 0X1FF;
+    uint16_t n = 512 - offset;
+    if(n > file_size - current_position)
+        n = file_size - current_position;
+
+    *data = fs->get_buffer_data_ptr() + offset;
+    return n;
+}
+
+bool File::consume(uint16_t count)
+{
+    if(!is_open() || count > file_size - current_position)
+        return false;
+
+    return seek_set(current_position + count);
+}
+
+bool File::current_block(uint32_t *block, uint8_t *run)
+{
+    if (type == Type::ROOT16) {
+        *block = fs->get_root_start() + (current_position >> 9);
+        *run = 0XFF;
+        return true;
+    }
+
+    uint8_t blockOfCluster = fs->get_block(current_position);
+    if ((current_position & 0X1FF) == 0 && blockOfCluster == 0) {
+        // start of new cluster
+        if (current_position == 0) {
+            // use first cluster in file
+            current_cluster = first_cluster;
+        } else {
+            // get next cluster from extent map or FAT
+            uint32_t index = current_position >> (fs->get_cluster_size_shift() + 9);
+            uint32_t next;
+            if (extent_find(index, &next) != index) {
+                if (!fs->get_fat(current_cluster, &next))
+                    return false;
+                if (fs->is_eoc(next)) {
+                    // end of directory - its size is known now,
+                    // a file chain shorter than its size is an error
+                    if (is_dir()) {
+                        file_size = current_position;
+                        if (type == Type::ROOT32)
+                            fs->set_root_size(file_size);
+                    }
+                    return false;
+                }
+                extent_add(index, next);
+            }
+            current_cluster = next;
+        }
+    }
+    *block = fs->get_start_block(current_cluster) + blockOfCluster;
+    *run = fs->get_blocks_per_cluster() - blockOfCluster;
+    return true;
 }
 
 uint8_t File::is_unbuffered_read()
@@ -252,6 +320,10 @@ bool File::is_open()
 
 bool File::close()
 {
+    // give back reserved clusters that were not written
+    if((flags & F_FILE_PREALLOC) && !truncate(file_size))
+        return false;
+
     if(!sync())
         return false;
     type = Type::CLOSED;
@@ -278,7 +350,7 @@ bool File::sync()
         // clear directory dirty
         flags &= ~F_FILE_DIR_DIRTY;
     }
-    return fs->flush_cache();
+    return fs->sync();
 }
 
 dir_t* File::cache_dir_entry(uint8_t action)
@@ -299,18 +371,54 @@ bool File::open(File &dir, const char *filename, uint8_t oflag)
 
     if (!make83name(filename, dname)) 
         return false;
+
+    DirIndex *dindex = fs->find_dir_index(dir.first_cluster);
+    uint16_t hash = DirIndex::hash(dname);
+
+    // index is built by the first open in the directory
+    if (dindex && dindex->get_state() == DirIndex::State::EMPTY)
+        if (!dir.build_index(dindex))
+            return false;
+
+    if (dindex && dindex->get_state() == DirIndex::State::BUILT) {
+        if (!dir.index_find(dindex, dname, hash, &p))
+            return false;
+        if (p) {
+            // don't open existing file if O_CREAT and O_EXCL
+            if ((oflag & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL))
+                return false;
+
+            return open_cached_entry(p - fs->get_buffer_dir_ptr(), oflag);
+        }
+
+        // only create file if O_CREAT and O_WRITE
+        if ((oflag & (O_CREAT | O_WRITE)) != (O_CREAT | O_WRITE))
+            return false;
+
+        if (!dir.index_take_free(dindex, hash, &p))
+            return false;
+        if (p) {
+            dir_index = p - fs->get_buffer_dir_ptr();
+            return create_entry(p, dname, oflag);
+        }
+        // no free entry known, scan for one and add a cluster if needed
+    }
     
     dir.rewind();
 
     // bool for empty entry found
     bool emptyFound = false;
 
-    // search for file
-    while (dir.get_current_position() < dir.get_file_size()) {
+    // search for file until end of directory chain
+    for (;;) {
         uint8_t index = 0XF & (dir.get_current_position() >> 5);
         p = dir.read_dir_cache();
-        if (!p)
-            return false;
+        if (!p) {
+            // read error unless the end was reached
+            if (dir.get_current_position() < dir.get_file_size())
+                return false;
+            break;
+        }
 
         if (p->name[0] == DIR_NAME_FREE || p->name[0] == DIR_NAME_DELETED) {
             // remember first empty slot
@@ -353,8 +461,99 @@ bool File::open(File &dir, const char *filename, uint8_t oflag)
         // use first entry in cluster
         dir_index = 0;
         p = fs->get_buffer_dir_ptr();
+
+        // rest of the new cluster is free for later creates
+        if (dindex && dindex->get_state() == DirIndex::State::BUILT) {
+            uint32_t block = fs->get_cache_block_no();
+            uint16_t n = fs->get_blocks_per_cluster() << 4;
+            for (uint16_t i = 1; i < n; i++)
+                dindex->add(DirIndex::FREE, block + (i >> 4), 0XF & i);
+        }
+    }
+
+    if (dindex && dindex->get_state() == DirIndex::State::BUILT)
+        dindex->add(hash, fs->get_cache_block_no(), dir_index);
+
+    return create_entry(p, dname, oflag);
+}
+
+bool File::open(const char *path, uint8_t oflag)
+{
+    char name[13];
+    File dir(fs);
+
+    if (is_open() || !dir.open_root())
+        return false;
+
+    for (;;) {
+        while (*path == '/')
+            path++;
+
+        // "/" is the root, later components are never empty
+        if (!*path)
+            return open_root();
+
+        // copy one component
+        uint8_t n = 0;
+        while (*path && *path != '/') {
+            if (n == sizeof(name) - 1)
+                return false;
+            name[n++] = *path++;
+        }
+        name[n] = 0;
+
+        while (*path == '/')
+            path++;
+        if (!*path)
+            return open(dir, name, oflag);
+
+        File sub(fs);
+        if (!sub.open_dir(dir, name))
+            return false;
+        dir = sub;
     }
+}
 
+bool File::open_dir(File &dir, const char *name)
+{
+    dentry_t d;
+    if (!make83name(name, d.name))
+        return false;
+    d.parent = dir.first_cluster;
+
+    // known directory opens without reading its entry
+    dentry_t *known = fs->dentry_find(d.parent, d.name);
+    if (known) {
+        type = Type::SUBDIR;
+        first_cluster = known->cluster;
+        file_size = DIR_SIZE_UNKNOWN;
+        flags = O_READ;
+        contiguous = false;
+        contiguous_known = true;
+        current_cluster = 0;
+        current_position = 0;
+        dir_block = known->dir_block;
+        dir_index = known->dir_index;
+        extent_reset();
+        return true;
+    }
+
+    if (!open(dir, name, O_READ))
+        return false;
+    if (type != Type::SUBDIR) {
+        type = Type::CLOSED;
+        return false;
+    }
+
+    d.cluster = first_cluster;
+    d.dir_block = dir_block;
+    d.dir_index = dir_index;
+    fs->dentry_add(&d);
+    return true;
+}
+
+bool File::create_entry(dir_t *p, const uint8_t *dname, uint8_t oflag)
+{
     // initialize as empty file
     memset(p, 0, sizeof(dir_t));
     memcpy(p->name, dname, 11);
@@ -376,35 +575,178 @@ bool File::open(File &dir, const char *filename, uint8_t oflag)
     return open_cached_entry(dir_index, oflag);
 }
 
+bool File::build_index(DirIndex *index)
+{
+    index->clear();
+    rewind();
+
+    for (;;) {
+        uint8_t i = 0XF & (current_position >> 5);
+        dir_t* p = read_dir_cache();
+        if (!p) {
+            // read error unless the end was reached
+            if (current_position < get_file_size())
+                return false;
+            break;
+        }
+
+        uint16_t hash;
+        if (p->name[0] == DIR_NAME_FREE || p->name[0] == DIR_NAME_DELETED)
+            hash = DirIndex::FREE;
+        else if (DIR_IS_LONG_NAME(p))
+            continue;
+        else
+            hash = DirIndex::hash(p->name);
+
+        // names that don't fit leave the index in overflow, opens scan
+        if (!index->add(hash, fs->get_cache_block_no(), i) &&
+            index->get_state() == DirIndex::State::OVERFLOW)
+            return true;
+    }
+
+    index->set_state(DirIndex::State::BUILT);
+    return true;
+}
+
+bool File::index_find(DirIndex *index, const uint8_t *dname, uint16_t hash, dir_t **entry)
+{
+    *entry = nullptr;
+    for (uint16_t i = index->find(hash, 0); i != DirIndex::NONE; i = index->find(hash, i + 1)) {
+        dir_index_entry_t *e = index->get(i);
+        // a block that can't be read may hold the name, not found would duplicate it
+        if (!fs->cache_raw_block(e->block, FAT::CACHE_FOR_READ))
+            return false;
+
+        dir_t* p = fs->get_buffer_dir_ptr() + e->index;
+        if (!memcmp(dname, p->name, 11)) {
+            *entry = p;
+            break;
+        }
+    }
+    return true;
+}
+
+bool File::index_take_free(DirIndex *index, uint16_t hash, dir_t **entry)
+{
+    *entry = nullptr;
+    uint16_t i;
+    while ((i = index->find(DirIndex::FREE, 0)) != DirIndex::NONE) {
+        dir_index_entry_t *e = index->get(i);
+        if (!fs->cache_raw_block(e->block, FAT::CACHE_FOR_READ))
+            return false;
+
+        dir_t* p = fs->get_buffer_dir_ptr() + e->index;
+        if (p->name[0] == DIR_NAME_FREE || p->name[0] == DIR_NAME_DELETED) {
+            // block is already cached, this only marks it dirty
+            if (!fs->cache_raw_block(e->block, FAT::CACHE_FOR_WRITE))
+                return false;
+            e->hash = hash;
+            *entry = p;
+            break;
+        }
+
+        // entry was taken behind the index's back, keep its name
+        e->hash = DirIndex::hash(p->name);
+    }
+    return true;
+}
+
 bool File::add_dir_cluster()
 {
     if(!add_cluster())
         return false;
 
-    // zero data in cluster insure first cluster is in cache
+    // zero data in cluster insure first block is in cache
     uint32_t block = fs->get_start_block(current_cluster);
-    for (uint8_t i = fs->get_blocks_per_cluster(); i != 0; i--) {
-        if (!fs->cache_zero_block(block + i - 1))
-            return false;
-    }
+    uint8_t n = fs->get_blocks_per_cluster();
+    if (n > 1 && !fs->zero_blocks(block + 1, block + n - 1))
+        return false;
+    if (!fs->cache_zero_block(block))
+        return false;
     // Increase directory file size by cluster size
-    file_size += 512UL << fs->get_cluster_size_shift();
+    if (file_size != DIR_SIZE_UNKNOWN) {
+        file_size += 512UL << fs->get_cluster_size_shift();
+        if (type == Type::ROOT32)
+            fs->set_root_size(file_size);
+    }
     return true;
 }
 
 bool File::add_cluster()
 {
-    if(!fs->alloc_contiguous(1, &current_cluster))
+    uint32_t last = current_cluster;
+
+    if(flags & F_FILE_ALIGN){
+        if(!fs->alloc_aligned(&current_cluster))
+            return false;
+    } else if(!fs->alloc_contiguous(1, &current_cluster)){
         return false;
+    }
 
     // if first cluster of file link to directory entry
     if (first_cluster == 0) {
         first_cluster = current_cluster;
         flags |= F_FILE_DIR_DIRTY;
+        extent_reset();
+    } else if (current_cluster != last + 1) {
+        contiguous = false;
+        contiguous_known = true;
+    }
+    return true;
+}
+
+bool File::preallocate(uint32_t bytes)
+{
+    if (!is_file() || !(flags & O_WRITE))
+        return false;
+
+    // clusters the file should own
+    uint8_t shift = fs->get_cluster_size_shift() + 9;
+    uint32_t need = (bytes >> shift) + ((bytes & ((1UL << shift) - 1)) != 0);
+
+    // find end of chain and check it is contiguous on the way
+    uint32_t have = 0;
+    uint32_t last = first_cluster;
+    contiguous = true;
+    if (first_cluster && !fs->get_chain_end(&last, &have, &contiguous))
+        return false;
+    contiguous_known = true;
+    if (need <= have)
+        return true;
+
+    // one allocator pass for the whole run, linked to the chain
+    uint32_t cluster = last;
+    if (!fs->alloc_contiguous(need - have, &cluster))
+        return false;
+
+    if (!first_cluster) {
+        first_cluster = cluster;
+        flags |= F_FILE_DIR_DIRTY;
+        extent_reset();
+    } else if (cluster != last + 1) {
+        contiguous = false;
     }
+    for (uint32_t i = 0; i < need - have; i++)
+        extent_add(have + i, cluster + i);
+
+    // file size is unchanged, close() trims what is not written
+    flags |= F_FILE_PREALLOC;
     return true;
 }
 
+bool File::is_contiguous()
+{
+    // chain of an opened file is walked on the first call
+    if (!contiguous_known) {
+        uint32_t last = first_cluster;
+        uint32_t count;
+        if (!fs->get_chain_end(&last, &count, &contiguous))
+            return false;
+        contiguous_known = true;
+    }
+    return contiguous;
+}
+
 bool File::make83name(const char *str, uint8_t *name)
 {
     uint8_t c;
@@ -445,6 +787,14 @@ uint32_t File::get_current_position()
 
 uint32_t File::get_file_size()
 {
+    if (file_size == DIR_SIZE_UNKNOWN) {
+        // follow directory chain to its end
+        uint32_t size;
+        bool ok = type == Type::ROOT32 ? fs->get_root_size(&size) :
+                                         fs->get_chain_size(first_cluster, &size);
+        if (ok)
+            file_size = size;
+    }
     return file_size;
 }
 
@@ -466,20 +816,26 @@ bool File::open_cached_entry(uint8_t dir_index, uint8_t oflag)
     // copy first cluster number for directory fields
     first_cluster = (uint32_t)p->firstClusterHigh << 16;
     first_cluster |= p->firstClusterLow;
+    extent_reset();
+
+    // an empty file is contiguous, a chain is walked when asked
+    contiguous = true;
+    contiguous_known = first_cluster == 0;
 
     // make sure it is a normal file or subdirectory
     if (DIR_IS_FILE(p)) {
         file_size = p->fileSize;
         type = Type::NORMAL;
     } else if (DIR_IS_SUBDIR(p)) {
-        if (!fs->get_chain_size(first_cluster, &file_size))
-            return false;
+        // found when reading hits end of chain or get_file_size() asks
+        file_size = DIR_SIZE_UNKNOWN;
         type = Type::SUBDIR;
     } else {
         return false;
     }
     // save open flags for read/write
     flags = oflag & (O_ACCMODE | O_SYNC | O_APPEND);
+    if (oflag & O_ALIGN) flags |= F_FILE_ALIGN;
 
     // set to start of file
     current_cluster = 0;
@@ -505,8 +861,8 @@ bool File::truncate(uint32_t length)
     if (length > file_size)
         return false;
 
-    // fileSize and length are zero - nothing to do
-    if (file_size == 0)
+    // no clusters allocated - nothing to do
+    if (first_cluster == 0)
         return true;
 
     // remember position for seek after truncation
@@ -521,6 +877,8 @@ bool File::truncate(uint32_t length)
         if (!fs->free_chain(first_cluster))
             return false;
         first_cluster = 0;
+        contiguous = true;
+        contiguous_known = true;
     } else {
         uint32_t toFree;
         if (!fs->get_fat(current_cluster, &toFree))
@@ -538,6 +896,10 @@ bool File::truncate(uint32_t length)
     }
     file_size = length;
 
+    // freed clusters may be in the extent map
+    extent_reset();
+    flags &= ~F_FILE_PREALLOC;
+
     // need to update directory entry
     flags |= F_FILE_DIR_DIRTY;
 
@@ -573,21 +935,113 @@ bool File::seek_set(uint32_t pos)
     uint32_t nCur = (current_position - 1) >> (fs->get_cluster_size_shift() + 9);
     uint32_t nNew = (pos - 1) >> (fs->get_cluster_size_shift() + 9);
 
-    if (nNew < nCur || current_position == 0) {
-        // must follow chain from first cluster
-        current_cluster = first_cluster;
+    // nearest known cluster from extent map, at worst the first cluster
+    uint32_t cluster;
+    uint32_t n = extent_find(nNew, &cluster);
+
+    if (nNew < nCur || current_position == 0 || n > nCur) {
+        current_cluster = cluster;
     } else {
         // advance from curPosition
-        nNew -= nCur;
+        n = nCur;
     }
-    while (nNew--) {
+
+    // follow chain for the rest
+    while (n < nNew) {
         if (!fs->get_fat(current_cluster, &current_cluster))
             return false;
+        extent_add(++n, current_cluster);
     }
     current_position = pos;
     return true;
 }
 
+void File::extent_reset()
+{
+#if FILE_EXTENT_SLOTS
+    for (uint8_t i = 0; i < FILE_EXTENT_SLOTS; i++)
+        extents[i].count = 0;
+
+    if (first_cluster)
+        extent_add(0, first_cluster);
+#endif
+}
+
+uint32_t File::extent_find(uint32_t index, uint32_t *cluster)
+{
+    // first cluster is always known
+    uint32_t best = 0;
+    *cluster = first_cluster;
+
+#if FILE_EXTENT_SLOTS
+    // highest known cluster index not past index
+    for (uint8_t i = 0; i < FILE_EXTENT_SLOTS; i++) {
+        extent_t *e = &extents[i];
+        if (!e->count || e->index > index)
+            continue;
+
+        uint32_t last = e->index + e->count - 1;
+        if (last > index)
+            last = index;
+        if (last > best) {
+            best = last;
+            *cluster = e->cluster + (last - e->index);
+        }
+    }
+#endif
+    return best;
+}
+
+void File::extent_add(uint32_t index, uint32_t cluster)
+{
+#if FILE_EXTENT_SLOTS
+    extent_t *unused = nullptr;
+    for (uint8_t i = 0; i < FILE_EXTENT_SLOTS; i++) {
+        extent_t *e = &extents[i];
+        if (!e->count) {
+            if (!unused)
+                unused = e;
+            continue;
+        }
+
+        // already known
+        if (index >= e->index && index < e->index + e->count)
+            return;
+
+        // run goes on
+        if (index == e->index + e->count && cluster == e->cluster + e->count) {
+            e->count++;
+            return;
+        }
+    }
+
+    // map full - the chain walk stays the fallback
+    if (unused) {
+        unused->index = index;
+        unused->cluster = cluster;
+        unused->count = 1;
+    }
+#else
+    (void)index;
+    (void)cluster;
+#endif
+}
+
+uint32_t File::extent_run(uint32_t index)
+{
+#if FILE_EXTENT_SLOTS
+    // clusters known to follow index on the volume
+    for (uint8_t i = 0; i < FILE_EXTENT_SLOTS; i++) {
+        extent_t *e = &extents[i];
+        if (e->count && index >= e->index && index < e->index + e->count)
+            return e->index + e->count - 1 - index;
+    }
+#else
+    (void)index;
+#endif
+    return 0;
+}
+
 File::Type File::get_type()
 {
     return type;
@@ -621,17 +1075,22 @@ size_t File::write(const uint8_t *buffer, uint16_t size)
                     current_cluster = first_cluster;
                 }
             } else {
+                // next cluster from extent map or FAT
+                uint32_t index = current_position >> (fs->get_cluster_size_shift() + 9);
                 uint32_t next;
-                if(!fs->get_fat(current_cluster, &next))
-                    return written;
-                
-                if(fs->is_eoc(next)){
-                    // add cluster if at end of chain
-                    if(!add_cluster())
+                if(extent_find(index, &next) != index){
+                    if(!fs->get_fat(current_cluster, &next))
                         return written;
-                } else {
-                    current_cluster = next;
+
+                    if(fs->is_eoc(next)){
+                        // add cluster if at end of chain
+                        if(!add_cluster())
+                            return written;
+                        next = current_cluster;
+                    }
+                    extent_add(index, next);
                 }
+                current_cluster = next;
             }
         }
 
@@ -643,24 +1102,22 @@ size_t File::write(const uint8_t *buffer, uint16_t size)
 
         // block for data write
         uint32_t block = fs->get_start_block(current_cluster) + boc;
-        if(n == 512){
-            // full block - don't need to use cache
-            // invalidade cache if block is in cache
-            if(fs->get_cache_block_no() == block)
-                fs->set_cache_block_no(0XFFFFFFFF);
-            
-            if(!fs->write_block(block, src))
+        // full block - don't need to use cache, unless it is pinned there
+        if(n == 512 && fs->cache_invalidate(block, block)){
+            // stream whole blocks, pre-erase only the rest of the request the
+            // file owns from here, other files may follow this cluster
+            uint32_t index = current_position >> (fs->get_cluster_size_shift() + 9);
+            uint32_t owned = fs->get_blocks_per_cluster() - boc +
+                (extent_run(index) << fs->get_cluster_size_shift());
+            if(!fs->write_multiple(block, src, (size - written) >> 9, owned))
                 return written;
 
             src += 512;
         } else {
             if(!w_offset && current_position >= file_size){
                 // start of new block don't need to read into cache
-                if(!fs->flush_cache())
+                if(!fs->cache_raw_block(block, FAT::CACHE_RESERVE_FOR_WRITE))
                     return written;
-
-                fs->set_cache_block_no(block);
-                fs->set_cache_dirty();
             } else {
                 // rewrite part of block
                 if(!fs->cache_raw_block(block, FAT::CACHE_FOR_WRITE))
@@ -689,7 +1146,7 @@ size_t File::write(const uint8_t *buffer, uint16_t size)
 
 bool File::seek_end()
 {
-    return seek_set(file_size);
+    return seek_set(get_file_size());
 }
 
 
@@ -698,7 +1155,7 @@ uint32_t File::available()
     if(!is_open())
         return 0;
 
-    uint32_t n = file_size - current_position;
+    uint32_t n = get_file_size() - current_position;
 
     return n > 0x7FFF ? 0x7FFF : n;
 }
@@ -716,6 +1173,7 @@ bool File::rm()
 
     // mark entry deleted
     d->name[0] = DIR_NAME_DELETED;
+    fs->dir_index_drop(dir_block, dir_index);
 
     // set this SdFile closed
     type = Type::CLOSED;
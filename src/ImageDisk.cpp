@@ -0,0 +1,280 @@
+/**
+ * @file ImageDisk.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Block device backed by a disk image file, for host builds.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+// avr-libc has no file streams, this device only exists on the host
+#ifndef __AVR__
+
+#include <ImageDisk.h>
+#include <sys/types.h>
+#include <string.h>
+
+ImageDisk::ImageDisk(const char *path)
+{
+    this->path = path;
+    image = nullptr;
+    block_count = 0;
+    write_block_no = 0;
+    in_write_multiple = false;
+    bad_block = NO_BLOCK;
+    set_au_model(0);
+    clear_counters();
+}
+
+bool ImageDisk::init()
+{
+    close();
+    image = fopen(path, "r+b");
+    if(!image)
+        return false;
+
+    if(fseeko(image, 0, SEEK_END)){
+        close();
+        return false;
+    }
+    block_count = ftello(image) >> 9;
+    return true;
+}
+
+void ImageDisk::close()
+{
+    if(image){
+        fclose(image);
+        image = nullptr;
+    }
+    in_write_multiple = false;
+}
+
+uint32_t ImageDisk::get_block_count()
+{
+    return block_count;
+}
+
+bool ImageDisk::seek(uint32_t block, uint16_t offset)
+{
+    if(!image || block >= block_count)
+        return false;
+
+    return !fseeko(image, ((off_t)block << 9) + offset, SEEK_SET);
+}
+
+bool ImageDisk::read_block(uint32_t block, uint8_t *dst)
+{
+    return read_data(block, 0, 512, dst);
+}
+
+bool ImageDisk::read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *dst)
+{
+    if((count + offset) > 512 || block == bad_block || !seek(block, offset))
+        return false;
+
+    command_count++;
+    read_count++;
+    return fread(dst, 1, count, image) == count;
+}
+
+bool ImageDisk::read_blocks(uint32_t block, uint16_t count, uint8_t *dst)
+{
+    if(block + count > block_count || !seek(block, 0))
+        return false;
+    if(bad_block >= block && bad_block < block + count)
+        return false;
+
+    // CMD18 and CMD12
+    command_count += 2;
+    read_count += count;
+    return fread(dst, 512, count, image) == count;
+}
+
+bool ImageDisk::write_block(uint32_t block, const uint8_t *src)
+{
+    if(!seek(block, 0))
+        return false;
+
+    // CMD24 and CMD13
+    command_count += 2;
+    write_count++;
+    au_write(block);
+    return fwrite(src, 1, 512, image) == 512;
+}
+
+bool ImageDisk::write_start(uint32_t block, uint32_t erase_count)
+{
+    // ACMD23 and CMD25
+    command_count += erase_count ? 3 : 1;
+    write_block_no = block;
+    in_write_multiple = true;
+    return true;
+}
+
+bool ImageDisk::write_next(const uint8_t *src)
+{
+    if(!in_write_multiple || !seek(write_block_no, 0) ||
+       fwrite(src, 1, 512, image) != 512){
+        in_write_multiple = false;
+        return false;
+    }
+    write_count++;
+    au_write(write_block_no++);
+    return true;
+}
+
+bool ImageDisk::write_stop()
+{
+    in_write_multiple = false;
+    return true;
+}
+
+bool ImageDisk::is_write_next(uint32_t block)
+{
+    return in_write_multiple && block == write_block_no;
+}
+
+bool ImageDisk::sync()
+{
+    in_write_multiple = false;
+    return image && !fflush(image);
+}
+
+bool ImageDisk::erase(uint32_t first_block, uint32_t last_block)
+{
+    static const uint8_t zero[512] = {0};
+
+    if(first_block > last_block || !seek(first_block, 0) || last_block >= block_count)
+        return false;
+
+    // CMD32, CMD33 and CMD38
+    command_count += 3;
+    for(uint32_t block = first_block; block <= last_block; block++){
+        if(fwrite(zero, 1, 512, image) != 512)
+            return false;
+    }
+    return true;
+}
+
+uint8_t ImageDisk::get_erase_value()
+{
+    return 0;
+}
+
+uint16_t ImageDisk::get_erase_size()
+{
+    return 1;
+}
+
+uint32_t ImageDisk::get_read_count()
+{
+    return read_count;
+}
+
+uint32_t ImageDisk::get_write_count()
+{
+    return write_count;
+}
+
+uint32_t ImageDisk::get_command_count()
+{
+    return command_count;
+}
+
+void ImageDisk::clear_counters()
+{
+    read_count = write_count = command_count = 0;
+    au_merges = au_copies = 0;
+}
+
+void ImageDisk::set_bad_block(uint32_t block)
+{
+    bad_block = block;
+}
+
+void ImageDisk::set_au_model(uint32_t blocks)
+{
+    au_blocks = blocks;
+    for(uint8_t i = 0; i < AU_OPEN; i++)
+        open_aus[i].au = NO_AU;
+}
+
+void ImageDisk::au_write(uint32_t block)
+{
+    if(!au_blocks)
+        return;
+
+    uint32_t au = block / au_blocks;
+    uint8_t i = 0;
+    while(i < AU_OPEN - 1 && open_aus[i].au != au)
+        i++;
+
+    // not open - the least recently written one makes room
+    open_au_t hit = open_aus[i];
+    if(hit.au != au){
+        au_close(&hit);
+        hit.au = au;
+        hit.written = 0;
+        hit.in_order = true;
+    }
+
+    if(hit.in_order && block % au_blocks == hit.written)
+        hit.written++;
+    else
+        hit.in_order = false;
+
+    // move to front
+    memmove(&open_aus[1], &open_aus[0], i * sizeof(open_au_t));
+    open_aus[0] = hit;
+}
+
+void ImageDisk::au_close(open_au_t *au)
+{
+    if(au->au == NO_AU)
+        return;
+
+    uint32_t copies = au->in_order ? au_blocks - au->written : au_blocks;
+    if(copies){
+        au_merges++;
+        au_copies += copies;
+    }
+    au->au = NO_AU;
+}
+
+void ImageDisk::close_aus()
+{
+    for(uint8_t i = 0; i < AU_OPEN; i++)
+        au_close(&open_aus[i]);
+}
+
+uint32_t ImageDisk::get_au_merges()
+{
+    return au_merges;
+}
+
+uint32_t ImageDisk::get_au_copies()
+{
+    return au_copies;
+}
+
+#endif /* __AVR__ */
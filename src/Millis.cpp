@@ -17,6 +17,41 @@
 bool Millis::initialized = false;
 uint32_t Millis::counter = 0;
 
+#ifdef MILLIS_TICKLESS
+
+uint8_t Millis::last_count = 0;
+uint32_t Millis::fraction = 0;
+
+void Millis::init()
+{
+    if(initialized)
+        return;
+    initialized = true;
+
+    // Timer 2 normal mode, prescaler 1024, no interrupt
+    TCCR2A = 0;
+    TCCR2B = (1 << CS22) | (1 << CS21) | (1 << CS20);
+    TCNT2 = 0;
+}
+
+uint32_t Millis::get()
+{
+    // ticks since the last call, the 8 bit timer wraps every 256 ticks
+    uint8_t now = TCNT2;
+    uint8_t ticks = now - last_count;
+    last_count = now;
+
+    // 1024 cycles per tick, fraction holds cycles not yet counted
+    fraction += (uint32_t)ticks << 10;
+    while(fraction >= F_CPU / 1000UL){
+        fraction -= F_CPU / 1000UL;
+        counter++;
+    }
+    return counter;
+}
+
+#else
+
 ISR(TIMER2_COMPA_vect)
 {
     Millis::counter++;
@@ -43,4 +78,23 @@ uint32_t Millis::get()
         temp = counter;
     }
     return temp;
+}
+
+#endif
+
+Deadline::Deadline(uint16_t milliseconds, uint8_t interval)
+{
+    start = Millis::get();
+    timeout = milliseconds;
+    this->interval = interval;
+    polls = interval;
+}
+
+bool Deadline::expired()
+{
+    if(--polls)
+        return false;
+    polls = interval;
+
+    return Millis::get() - start >= timeout;
 }
\ No newline at end of file
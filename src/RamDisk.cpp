@@ -0,0 +1,127 @@
+/**
+ * @file RamDisk.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Block device kept in a caller supplied RAM buffer.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <RamDisk.h>
+
+RamDisk::RamDisk(uint8_t *data, uint32_t block_count)
+{
+    this->data = data;
+    this->block_count = block_count;
+    write_block_no = 0;
+    in_write_multiple = false;
+}
+
+uint32_t RamDisk::get_block_count()
+{
+    return block_count;
+}
+
+bool RamDisk::read_block(uint32_t block, uint8_t *dst)
+{
+    return read_data(block, 0, 512, dst);
+}
+
+bool RamDisk::read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *dst)
+{
+    if(block >= block_count || (count + offset) > 512)
+        return false;
+
+    memcpy(dst, data + (block << 9) + offset, count);
+    return true;
+}
+
+bool RamDisk::read_blocks(uint32_t block, uint16_t count, uint8_t *dst)
+{
+    if(block + count > block_count)
+        return false;
+
+    memcpy(dst, data + (block << 9), (uint32_t)count << 9);
+    return true;
+}
+
+bool RamDisk::write_block(uint32_t block, const uint8_t *src)
+{
+    if(block >= block_count)
+        return false;
+
+    memcpy(data + (block << 9), src, 512);
+    return true;
+}
+
+bool RamDisk::write_start(uint32_t block, uint32_t erase_count)
+{
+    write_block_no = block;
+    in_write_multiple = true;
+    return true;
+}
+
+bool RamDisk::write_next(const uint8_t *src)
+{
+    if(!in_write_multiple || !write_block(write_block_no, src)){
+        in_write_multiple = false;
+        return false;
+    }
+    write_block_no++;
+    return true;
+}
+
+bool RamDisk::write_stop()
+{
+    in_write_multiple = false;
+    return true;
+}
+
+bool RamDisk::is_write_next(uint32_t block)
+{
+    return in_write_multiple && block == write_block_no;
+}
+
+bool RamDisk::sync()
+{
+    in_write_multiple = false;
+    return true;
+}
+
+bool RamDisk::erase(uint32_t first_block, uint32_t last_block)
+{
+    if(first_block > last_block || last_block >= block_count)
+        return false;
+
+    memset(data + (first_block << 9), 0, (last_block - first_block + 1) << 9);
+    return true;
+}
+
+uint8_t RamDisk::get_erase_value()
+{
+    return 0;
+}
+
+uint16_t RamDisk::get_erase_size()
+{
+    return 1;
+}
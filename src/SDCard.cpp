@@ -28,6 +28,7 @@
  */
 
 #include <SDCard.h>
+#include <avr/pgmspace.h>
 
 SDCard::SDCard(volatile uint8_t *PORT_CS, volatile uint8_t *DDR_CS, uint8_t PIN_CS)
 {
@@ -37,6 +38,12 @@ SDCard::SDCard(volatile uint8_t *PORT_CS, volatile uint8_t *DDR_CS, uint8_t PIN_
     status = 0;
     block = 0;
     partial_block_read = 0;
+    in_read_multiple = 0;
+    in_write_multiple = 0;
+    write_block_no = 0;
+    async_op = ASYNC_NONE;
+    deferred_write = false;
+    write_pending = status_pending = 0;
 
     this->PORT_CS = PORT_CS;
     this->DDR_CS = DDR_CS;
@@ -50,9 +57,11 @@ bool SDCard::init()
 {
     Millis::init();
     error = Error::OK;
-    in_block = partial_block_read = 0;
+    in_block = partial_block_read = in_read_multiple = in_write_multiple = 0;
+    write_pending = status_pending = 0;
 
-    uint32_t then = Millis::get();
+    // every poll is a whole command that may wait for busy, check the clock each time
+    Deadline deadline(SD_INIT_TIMEOUT, 1);
     
     deselect();
 
@@ -73,8 +82,7 @@ bool SDCard::init()
 
     // Put SD Card in idle mode
     while ((status = send_cmd(CMD0, 0)) != R1_IDLE_STATE) {
-        uint16_t diff = Millis::get() - then;
-        if (diff > SD_INIT_TIMEOUT) {
+        if (deadline.expired()) {
             error = Error::CMD0;
             deselect();
             return false;
@@ -103,8 +111,7 @@ bool SDCard::init()
 
     while ((status = send_acmd(ACMD41, arg)) != R1_READY_STATE) {
         // Check for timeout
-        uint16_t diff = Millis::get() - then;
-        if (diff > SD_INIT_TIMEOUT) {
+        if (deadline.expired()) {
             error = Error::ACMD41;
             deselect();
             return false;
@@ -123,10 +130,166 @@ bool SDCard::init()
         for (uint8_t i = 0; i < 3; i++) SPI::read();
     }
 
+    // card geometry and identification
+    uint8_t reg[16];
+    if(!read_register(CMD9, reg))
+        return false;
+    if(!parse_csd(reg)){
+        error = Error::BAD_CSD;
+        deselect();
+        return false;
+    }
+    if(!read_register(CMD10, reg))
+        return false;
+    parse_cid(reg);
+
+    // allocation unit is optional, older cards may not report it
+    if(!read_sd_status()){
+        card_info.au_size = 0;
+        error = Error::OK;
+    }
+
+    // erased blocks read back as ones unless the SCR says otherwise
+    if(!read_scr()){
+        card_info.erase_value = 0xFF;
+        error = Error::OK;
+    }
+
+    // run as fast as both the card and the MCU allow
+    SPI::set_speed(card_info.max_clock);
+
     deselect();
     return true;
 }
 
+bool SDCard::read_register(uint8_t cmd, uint8_t *dst)
+{
+    if(send_cmd(cmd, 0)){
+        error = Error::READ_REG;
+        deselect();
+        return false;
+    }
+    if(!wait_start_block())
+        return false;
+
+    SPI::receive_block(dst, 16);
+
+    // discard crc
+    SPI::read();
+    SPI::read();
+    deselect();
+    return true;
+}
+
+bool SDCard::parse_csd(const uint8_t *csd)
+{
+    // TRAN_SPEED time value times ten, indexed by bits 6:3
+    static const uint8_t tran_value[16] PROGMEM = {
+        0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80
+    };
+
+    uint8_t structure = csd[0] >> 6;
+    if(structure > 1)
+        return false;
+
+    // TRAN_SPEED rate unit is 100kbit/s times a power of ten
+    uint8_t unit = csd[3] & 0X07;
+    uint32_t hz = 10000UL * pgm_read_byte(&tran_value[(csd[3] >> 3) & 0X0F]);
+    for(uint8_t i = 0; i < unit && i < 3; i++)
+        hz *= 10;
+    card_info.max_clock = hz;
+
+    if(structure == 0){
+        // CSD version 1.0
+        uint8_t read_bl_len = csd[5] & 0X0F;
+        uint16_t c_size = ((uint16_t)(csd[6] & 0X03) << 10) | ((uint16_t)csd[7] << 2) | (csd[8] >> 6);
+        uint8_t c_size_mult = ((csd[9] & 0X03) << 1) | (csd[10] >> 7);
+        card_info.blocks = (uint32_t)(c_size + 1) << (c_size_mult + read_bl_len - 7);
+    } else {
+        // CSD version 2.0 - capacity in 512KB units
+        uint32_t c_size = ((uint32_t)(csd[7] & 0X3F) << 16) | ((uint16_t)csd[8] << 8) | csd[9];
+        card_info.blocks = (c_size + 1) << 10;
+    }
+
+    // erase sector size is in units of the write block length
+    uint8_t write_bl_len = ((csd[12] & 0X03) << 2) | (csd[13] >> 6);
+    card_info.erase_single = (csd[10] >> 6) & 1;
+    card_info.erase_size = (((csd[10] & 0X3F) << 1) | (csd[11] >> 7)) + 1;
+    if(write_bl_len > 9)
+        card_info.erase_size <<= write_bl_len - 9;
+
+    return true;
+}
+
+bool SDCard::read_sd_status()
+{
+    // AU_SIZE code in 16KB units, 0 is not defined
+    static const uint16_t au_size[16] PROGMEM = {
+        0, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 768, 1024, 1536, 2048, 4096
+    };
+
+    // response is r2, second byte must be zero too
+    if(send_acmd(ACMD13, 0) || SPI::read()){
+        error = Error::READ_REG;
+        deselect();
+        return false;
+    }
+    if(!wait_start_block())
+        return false;
+
+    // fields of interest are in the first 16 of 64 bytes
+    uint8_t reg[16];
+    SPI::receive_block(reg, 16);
+
+    // discard rest of register and crc
+    for(uint8_t i = 0; i < 64 - 16 + 2; i++)
+        SPI::read();
+    deselect();
+
+    card_info.au_size = (uint32_t)pgm_read_word(&au_size[reg[10] >> 4]) << 5;
+    card_info.erase_au_count = ((uint16_t)reg[11] << 8) | reg[12];
+    card_info.erase_timeout = reg[13] >> 2;
+    card_info.erase_offset = reg[13] & 0X03;
+    return true;
+}
+
+bool SDCard::read_scr()
+{
+    if(send_acmd(ACMD51, 0)){
+        error = Error::READ_REG;
+        deselect();
+        return false;
+    }
+    if(!wait_start_block())
+        return false;
+
+    uint8_t scr[8];
+    SPI::receive_block(scr, 8);
+
+    // discard crc
+    SPI::read();
+    SPI::read();
+    deselect();
+
+    card_info.erase_value = (scr[1] & 0X80) ? 0xFF : 0x00;
+    return true;
+}
+
+void SDCard::parse_cid(const uint8_t *cid)
+{
+    card_info.manufacturer = cid[0];
+    card_info.oem[0] = cid[1];
+    card_info.oem[1] = cid[2];
+    card_info.oem[2] = 0;
+    for(uint8_t i = 0; i < 5; i++)
+        card_info.product[i] = cid[3 + i];
+    card_info.product[5] = 0;
+    card_info.revision = cid[8];
+    card_info.serial = ((uint32_t)cid[9] << 24) | ((uint32_t)cid[10] << 16) | ((uint16_t)cid[11] << 8) | cid[12];
+    card_info.year = 2000 + (((cid[13] & 0X0F) << 4) | (cid[14] >> 4));
+    card_info.month = cid[14] & 0X0F;
+}
+
 void SDCard::deselect()
 {
     *PORT_CS |= (1 << PIN_CS);
@@ -139,8 +302,22 @@ void SDCard::select()
 
 uint8_t SDCard::send_cmd(uint8_t cmd, uint32_t arg)
 {
+    // complete a background transfer before the bus is reused, its error fails the command
+    if(async_op && !finish_async())
+        return 0xFF;
+
     end_read();
 
+    // a deferred write must finish programming first
+    if(write_pending && !wait_write())
+        return 0xFF;
+
+    // a new command terminates an open multiple block read or write
+    if(in_read_multiple && !read_stop())
+        return 0xFF;
+    if(in_write_multiple && !write_stop())
+        return 0xFF;
+
     select();
 
     wait_busy(300);
@@ -155,6 +332,10 @@ uint8_t SDCard::send_cmd(uint8_t cmd, uint32_t arg)
     else if(cmd == CMD8) crc = 0x87;
     SPI::write(crc);
 
+    // the byte after CMD12 is a stuff byte, data may still be streaming
+    if(cmd == CMD12)
+        SPI::read();
+
     for (uint8_t i = 0; ((status = SPI::read()) & 0X80) && i != 0XFF; i++);
     return status;
 }
@@ -168,13 +349,13 @@ void SDCard::end_read()
     }
 }
 
-bool SDCard::wait_busy(uint32_t milliseconds)
+bool SDCard::wait_busy(uint16_t milliseconds)
 {
-    uint32_t then = Millis::get();
+    Deadline deadline(milliseconds);
     do {
         if(SPI::read() == 0xFF)
             return true;
-    } while(Millis::get() - then < milliseconds);
+    } while(!deadline.expired());
     return false;
 }
 
@@ -194,6 +375,55 @@ SDCard::Error SDCard::get_error()
     return error;
 }
 
+const SDCard::Info &SDCard::info()
+{
+    return card_info;
+}
+
+uint8_t SDCard::get_erase_value()
+{
+    return card_info.erase_value;
+}
+
+uint16_t SDCard::get_erase_size()
+{
+    return card_info.erase_single ? 1 : card_info.erase_size;
+}
+
+bool SDCard::erase(uint32_t first_block, uint32_t last_block)
+{
+    // without single block erase the range must be whole erase sectors
+    if(!card_info.erase_single){
+        if(first_block % card_info.erase_size || (last_block + 1) % card_info.erase_size){
+            error = Error::ERASE_SINGLE_BLOCK;
+            return false;
+        }
+    }
+
+    // use address if not SDHC card
+    if(type != Type::SDHC){
+        first_block <<= 9;
+        last_block <<= 9;
+    }
+
+    if(send_cmd(CMD32, first_block) ||
+       send_cmd(CMD33, last_block) ||
+       send_cmd(CMD38, 0)){
+        error = Error::ERASE;
+        deselect();
+        return false;
+    }
+
+    if(!wait_busy(SD_ERASE_TIMEOUT)){
+        error = Error::ERASE_TIMEOUT;
+        deselect();
+        return false;
+    }
+
+    deselect();
+    return true;
+}
+
 bool SDCard::write_block(uint32_t block_no, const uint8_t* src)
 {
     // don't allow write to first block
@@ -217,6 +447,70 @@ bool SDCard::write_block(uint32_t block_no, const uint8_t* src)
         return false;
     }
 
+    if(deferred_write){
+        // programming overlaps the caller until the next command
+        write_pending = status_pending = 1;
+        deselect();
+        return true;
+    }
+
+    return wait_programmed();
+}
+
+void SDCard::set_deferred_write(bool enable)
+{
+    deferred_write = enable;
+}
+
+bool SDCard::wait_write()
+{
+    // a busy card answers zeros, the write stays pending until it lets go
+    select();
+    if(!wait_busy(SD_WRITE_TIMEOUT)){
+        error = Error::WRITE_TIMEOUT;
+        deselect();
+        return false;
+    }
+    write_pending = 0;
+    return true;
+}
+
+bool SDCard::poll_ready()
+{
+    if(write_pending){
+        select();
+        bool busy = SPI::read() != 0xFF;
+        deselect();
+        if(busy)
+            return false;
+        write_pending = 0;
+    }
+    return true;
+}
+
+bool SDCard::sync()
+{
+    if(!write_stop())
+        return false;
+
+    if(write_pending && !wait_write())
+        return false;
+
+    // one status check covers every deferred write since the last one
+    if(status_pending){
+        status_pending = 0;
+        if(send_cmd(CMD13, 0) || SPI::read()){
+            error = Error::WRITE_PROGRAMMING;
+            deselect();
+            return false;
+        }
+    }
+    deselect();
+    return true;
+}
+
+bool SDCard::wait_programmed()
+{
     // wait for flash programming to complete
     if(!wait_busy(SD_WRITE_TIMEOUT)) {
         error = Error::WRITE_TIMEOUT;
@@ -235,13 +529,96 @@ bool SDCard::write_block(uint32_t block_no, const uint8_t* src)
     return true;
 }
 
+bool SDCard::write_start(uint32_t block_no, uint32_t erase_count)
+{
+    // don't allow write to first block
+    if (!block_no) {
+        error = Error::WRITE_BLOCK_ZERO;
+        deselect();
+        return false;
+    }
+
+    // send pre-erase count
+    if(erase_count && send_acmd(ACMD23, erase_count)){
+        error = Error::ACMD23;
+        deselect();
+        return false;
+    }
+
+    write_block_no = block_no;
+
+    // use address if not SDHC card
+    if(type != Type::SDHC) block_no <<= 9;
+
+    if(send_cmd(CMD25, block_no)){
+        error = Error::CMD25;
+        deselect();
+        return false;
+    }
+    in_write_multiple = 1;
+    return true;
+}
+
+bool SDCard::write_next(const uint8_t* src)
+{
+    if(!in_write_multiple)
+        return false;
+
+    // wait for previous block to be programmed
+    if(!wait_busy(SD_WRITE_TIMEOUT)){
+        error = Error::WRITE_MULTIPLE;
+    } else if(write_data(WRITE_MULTIPLE_TOKEN, src)){
+        write_block_no++;
+        return true;
+    }
+
+    // end the CMD25 so the card takes commands again, report the write error
+    Error write_error = error;
+    write_stop();
+    error = write_error;
+    return false;
+}
+
+bool SDCard::write_stop()
+{
+    if(!in_write_multiple)
+        return true;
+    in_write_multiple = 0;
+
+    // a failed write_next() deselected the card
+    select();
+    if(!wait_busy(SD_WRITE_TIMEOUT)){
+        error = Error::STOP_TRAN;
+        deselect();
+        return false;
+    }
+
+    SPI::write(STOP_TRAN_TOKEN);
+
+    if(!wait_busy(SD_WRITE_TIMEOUT)){
+        error = Error::STOP_TRAN;
+        deselect();
+        return false;
+    }
+    deselect();
+    return true;
+}
+
+bool SDCard::is_write_next(uint32_t block_no)
+{
+    return in_write_multiple && block_no == write_block_no;
+}
+
 bool SDCard::write_data(uint8_t token, const uint8_t* src)
 {
     SPI::write(token);
-    for (uint16_t i = 0; i < 512; i++) {
-        SPI::write(src[i]);
-    }
+    SPI::send_block(src, 512);
+
+    return write_response();
+}
 
+bool SDCard::write_response()
+{
     SPI::write(0xff);  // dummy crc
     SPI::write(0xff);  // dummy crc
 
@@ -291,9 +668,7 @@ bool SDCard::read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t
         SPI::read();
     }
     // transfer data
-    for (uint16_t i = 0; i < count; i++) {
-        dst[i] = SPI::read();
-    }
+    SPI::receive_block(dst, count);
 
     this->offset += count;
     if (!partial_block_read || this->offset >= 512) {
@@ -305,10 +680,9 @@ bool SDCard::read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t
 
 bool SDCard::wait_start_block()
 {
-    uint32_t then = Millis::get();
+    Deadline deadline(SD_READ_TIMEOUT);
     while((status = SPI::read()) == 0XFF){
-        uint16_t diff = Millis::get() - then;
-        if(diff > SD_READ_TIMEOUT){
+        if(deadline.expired()){
             error = Error::READ_TIMEOUT;
             deselect();
             return false;
@@ -322,4 +696,137 @@ bool SDCard::wait_start_block()
     return true;
 }
 
+bool SDCard::read_blocks(uint32_t block, uint16_t count, uint8_t *dst)
+{
+    if(!read_start(block))
+        return false;
+
+    for(uint16_t i = 0; i < count; i++, dst += 512){
+        if(!read_next(dst))
+            return false;
+    }
+
+    return read_stop();
+}
+
+bool SDCard::read_start(uint32_t block)
+{
+    // use address if not SDHC card
+    if(type != Type::SDHC) block <<= 9;
+
+    if(send_cmd(CMD18, block)){
+        error = Error::CMD18;
+        deselect();
+        return false;
+    }
+    in_read_multiple = 1;
+    return true;
+}
+
+bool SDCard::read_next(uint8_t *dst)
+{
+    if(!in_read_multiple)
+        return false;
+
+    if(!wait_start_block()){
+        // take the card out of CMD18, report the read error
+        Error read_error = error;
+        read_stop();
+        error = read_error;
+        return false;
+    }
+
+    SPI::receive_block(dst, 512);
+
+    // discard crc
+    SPI::read();
+    SPI::read();
+
+    return true;
+}
+
+bool SDCard::read_stop()
+{
+    in_read_multiple = 0;
+    if(send_cmd(CMD12, 0)){
+        error = Error::CMD12;
+        deselect();
+        return false;
+    }
+    deselect();
+    return true;
+}
+
+bool SDCard::read_block_async(uint32_t block, uint8_t *dst, SPI::Callback callback)
+{
+    // use address if not SDHC card
+    if(type != Type::SDHC) block <<= 9;
+
+    if(send_cmd(CMD17, block)){
+        error = Error::CMD17;
+        deselect();
+        return false;
+    }
+    if(!wait_start_block())
+        return false;
+
+    // card stays selected until finish_async()
+    async_op = ASYNC_READ;
+    SPI::receive_async(dst, 512, callback);
+    return true;
+}
+
+bool SDCard::write_block_async(uint32_t block_no, const uint8_t *src, SPI::Callback callback)
+{
+    // don't allow write to first block
+    if (!block_no) {
+        error = Error::WRITE_BLOCK_ZERO;
+        deselect();
+        return false;
+    }
+
+    // use address if not SDHC card
+    if(type != Type::SDHC) block_no <<= 9;
+
+    if(send_cmd(CMD24, block_no)){
+        error = Error::CMD24;
+        deselect();
+        return false;
+    }
+
+    SPI::write(DATA_START_BLOCK);
+
+    // card stays selected until finish_async()
+    async_op = ASYNC_WRITE;
+    SPI::send_async(src, 512, callback);
+    return true;
+}
+
+bool SDCard::is_async_busy()
+{
+    return SPI::is_busy();
+}
 
+bool SDCard::finish_async()
+{
+    uint8_t op = async_op;
+    if(op == ASYNC_NONE)
+        return true;
+
+    while(SPI::is_busy());
+    async_op = ASYNC_NONE;
+
+    if(op == ASYNC_READ){
+        // discard crc
+        SPI::read();
+        SPI::read();
+        deselect();
+        return true;
+    }
+
+    if(!write_response()){
+        deselect();
+        return false;
+    }
+    return wait_programmed();
+}
@@ -28,6 +28,41 @@
 #include <SPI.h>
 
 bool SPI::initialized = false;
+uint8_t *SPI::async_ptr = nullptr;
+uint16_t SPI::async_left = 0;
+bool SPI::async_rx = false;
+SPI::Callback SPI::async_callback = nullptr;
+volatile bool SPI::async_busy = false;
+
+static inline void send_next(uint8_t data)
+{
+    loop_until_bit_is_set(SPSR, SPIF);
+    SPDR = data;
+}
+
+static inline uint8_t receive_next()
+{
+    loop_until_bit_is_set(SPSR, SPIF);
+    uint8_t data = SPDR;
+    SPDR = 0xFF;
+    return data;
+}
+
+ISR(SPI_STC_vect)
+{
+    if(SPI::async_rx)
+        *SPI::async_ptr++ = SPDR;
+
+    if(--SPI::async_left){
+        SPDR = SPI::async_rx ? 0xFF : *SPI::async_ptr++;
+    } else {
+        // done - back to polled mode
+        SPCR &= ~(1 << SPIE);
+        SPI::async_busy = false;
+        if(SPI::async_callback)
+            SPI::async_callback();
+    }
+}
 
 void SPI::init(volatile uint8_t *DDR_SS, volatile uint8_t *DDR_SCK, volatile uint8_t *DDR_MOSI, volatile uint8_t *DDR_MISO,
                uint8_t PIN_SS, uint8_t PIN_SCK, uint8_t PIN_MOSI, uint8_t PIN_MISO, volatile uint8_t *PORT_SS)
@@ -49,10 +84,20 @@ void SPI::init(volatile uint8_t *DDR_SS, volatile uint8_t *DDR_SCK, volatile uin
     initialized = true;
 }
 
-void SPI::set_speed()
+void SPI::set_speed(uint32_t max_hz)
 {
-    SPCR &= ~((1 << SPR1) | (1 << SPR0));
-    SPSR |= (1 << SPI2X);
+    // fastest divider f_osc/2^shift not above max_hz, f_osc/128 at most
+    uint8_t shift = 1;
+    while(shift < 7 && ((uint32_t)F_CPU >> shift) > max_hz)
+        shift++;
+
+    uint8_t spr = shift == 7 ? 3 : (shift - 1) >> 1;
+    SPCR = (SPCR & ~((1 << SPR1) | (1 << SPR0))) | spr;
+
+    if(shift < 7 && (shift & 1))
+        SPSR |= (1 << SPI2X);
+    else
+        SPSR &= ~(1 << SPI2X);
 }
 
 void SPI::write(uint8_t data)
@@ -65,4 +110,86 @@ uint8_t SPI::read()
 {
     write(0xFF);
     return SPDR;
-}
\ No newline at end of file
+}
+
+void SPI::send_block(const uint8_t *src, uint16_t count)
+{
+    if(!count)
+        return;
+
+    SPDR = *src++;
+    count--;
+
+    // four bytes per pass, a 512 byte block has no remainder
+    while(count >= 4){
+        send_next(src[0]);
+        send_next(src[1]);
+        send_next(src[2]);
+        send_next(src[3]);
+        src += 4;
+        count -= 4;
+    }
+    while(count--)
+        send_next(*src++);
+
+    loop_until_bit_is_set(SPSR, SPIF);
+}
+
+void SPI::receive_block(uint8_t *dst, uint16_t count)
+{
+    if(!count)
+        return;
+
+    SPDR = 0xFF;
+    count--;
+
+    while(count >= 4){
+        dst[0] = receive_next();
+        dst[1] = receive_next();
+        dst[2] = receive_next();
+        dst[3] = receive_next();
+        dst += 4;
+        count -= 4;
+    }
+    while(count--)
+        *dst++ = receive_next();
+
+    loop_until_bit_is_set(SPSR, SPIF);
+    *dst = SPDR;
+}
+
+void SPI::send_async(const uint8_t *src, uint16_t count, Callback callback)
+{
+    if(!count)
+        return;
+
+    async_ptr = (uint8_t*)src;
+    async_left = count;
+    async_rx = false;
+    async_callback = callback;
+    async_busy = true;
+
+    // first byte clears a pending SPIF before the interrupt is enabled
+    SPDR = *async_ptr++;
+    SPCR |= (1 << SPIE);
+}
+
+void SPI::receive_async(uint8_t *dst, uint16_t count, Callback callback)
+{
+    if(!count)
+        return;
+
+    async_ptr = dst;
+    async_left = count;
+    async_rx = true;
+    async_callback = callback;
+    async_busy = true;
+
+    SPDR = 0xFF;
+    SPCR |= (1 << SPIE);
+}
+
+bool SPI::is_busy()
+{
+    return async_busy;
+}
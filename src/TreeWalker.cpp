@@ -0,0 +1,163 @@
+/**
+ * @file TreeWalker.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Depth first walk of a directory tree without recursion.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <TreeWalker.h>
+#include <DirIterator.h>
+
+/**
+ * The walk keeps one open directory for each level below the start in
+ * caller supplied storage, e.g. File levels[4] = {&fs, &fs, &fs, &fs}.
+ */
+TreeWalker::TreeWalker(File *levels, uint8_t depth) :
+    levels(levels), capacity(depth)
+{
+    this->depth = 0;
+    start = nullptr;
+    skipped = 0;
+}
+
+/**
+ * Calls the visitor for every entry below dir selected by options
+ * (File::LS_FILE, File::LS_FOLDER), descending into subdirectories if
+ * File::LS_R is set. Each directory block is read once, plus again after
+ * a subdirectory or a visitor used the cache. Returns false on error.
+ */
+bool TreeWalker::walk(File &dir, uint8_t options, visitor_t visitor, void *arg)
+{
+    start = &dir;
+    depth = 0;
+    skipped = 0;
+    dir.rewind();
+
+    for(;;){
+        File &cur = get_dir();
+        DirIterator it(cur, File::LS_FILE | File::LS_FOLDER);
+        it.seek(cur.get_current_position());
+
+        dir_t* p = it.next();
+        if(!p){
+            if(!it.is_end())
+                return false;
+
+            // done with the start directory
+            if(!depth)
+                return true;
+
+            // report the directory from inside, then continue in its parent
+            if((options & File::LS_FOLDER) && !visit(visitor, nullptr, Event::DIR_LEAVE, arg))
+                return true;
+            depth--;
+            continue;
+        }
+
+        // remember the entry for open_current()
+        entry_block = cur.fs->get_cache_block_no();
+        entry_index = 0XF & ((it.get_cookie() - 1) >> 5);
+
+        if(DIR_IS_FILE(p)){
+            if((options & File::LS_FILE) && !visit(visitor, p, Event::FILE, arg))
+                return true;
+            continue;
+        }
+
+        if((options & File::LS_FOLDER) && !visit(visitor, p, Event::DIR_ENTER, arg))
+            return true;
+        if(!(options & File::LS_R))
+            continue;
+
+        if(depth == capacity){
+            skipped++;
+            continue;
+        }
+
+        // reuse the level's cursor for the subdirectory, one the walk
+        // opened is read only and has nothing to sync
+        File &sub = levels[depth];
+        if(sub.is_open()){
+            if(sub.flags & File::O_WRITE){
+                if(!sub.close())
+                    return false;
+            } else {
+                sub.type = File::Type::CLOSED;
+            }
+        }
+        if(!open_current(sub, File::O_READ))
+            return false;
+        depth++;
+    }
+}
+
+bool TreeWalker::visit(visitor_t visitor, const dir_t *p, Event event, void *arg)
+{
+    File &cur = get_dir();
+    uint32_t pos = cur.get_current_position();
+
+    if(!visitor(*this, p, event, arg))
+        return false;
+
+    // the visitor may have opened files in the directory
+    if(cur.get_current_position() != pos)
+        cur.seek_set(pos);
+    return true;
+}
+
+/** Level of the current directory, 0 for the directory walk() started in. */
+uint8_t TreeWalker::get_depth()
+{
+    return depth;
+}
+
+/**
+ * Directory holding the current entry, or the directory being left for
+ * Event::DIR_LEAVE.
+ */
+File& TreeWalker::get_dir()
+{
+    return depth ? levels[depth - 1] : *start;
+}
+
+/** Subdirectories not entered because all levels were in use. */
+uint16_t TreeWalker::get_skipped()
+{
+    return skipped;
+}
+
+/**
+ * Opens the entry handed to the visitor without searching the directory
+ * by name, e.g. to read it or to rm() it.
+ */
+bool TreeWalker::open_current(File &file, uint8_t oflag)
+{
+    if(file.is_open())
+        return false;
+
+    if(!get_dir().fs->cache_raw_block(entry_block, FAT::CACHE_FOR_READ))
+        return false;
+
+    return file.open_cached_entry(entry_index, oflag);
+}
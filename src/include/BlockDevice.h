@@ -0,0 +1,62 @@
+/**
+ * @file BlockDevice.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Compile time selection of the disk under the FAT filesystem.
+ * 
+ * @details The FAT layer calls the device directly, without virtual
+ * dispatch. Any class used as BlockDevice must provide:
+ * 
+ *  bool read_block(uint32_t block, uint8_t *dst);
+ *  bool read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *dst);
+ *  bool read_blocks(uint32_t block, uint16_t count, uint8_t *dst);
+ *  bool write_block(uint32_t block, const uint8_t *src);
+ *  bool write_start(uint32_t block, uint32_t erase_count);
+ *  bool write_next(const uint8_t *src);
+ *  bool write_stop();
+ *  bool is_write_next(uint32_t block);
+ *  bool sync();
+ *  bool erase(uint32_t first_block, uint32_t last_block);
+ *  uint8_t get_erase_value();
+ *  uint16_t get_erase_size();
+ * 
+ * Define FAT_DEVICE_RAM or FAT_DEVICE_IMAGE to build the filesystem on
+ * a RAM disk or on a disk image file of the host. The SD card is the default.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BLOCKDEVICE_H_
+#define _BLOCKDEVICE_H_
+
+#if defined(FAT_DEVICE_RAM)
+#include <RamDisk.h>
+typedef RamDisk BlockDevice;
+#elif defined(FAT_DEVICE_IMAGE)
+#include <ImageDisk.h>
+typedef ImageDisk BlockDevice;
+#else
+#include <SDCard.h>
+typedef SDCard BlockDevice;
+#endif
+
+#endif /* _BLOCKDEVICE_H_ */
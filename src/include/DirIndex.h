@@ -0,0 +1,78 @@
+/**
+ * @file DirIndex.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Name lookup index for one directory, kept in caller supplied RAM.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DIRINDEX_H_
+#define _DIRINDEX_H_
+
+#include <stdint.h>
+
+struct dir_index_entry_t {
+           /** Hash of the 8.3 name, DirIndex::FREE for a free slot. */
+  uint16_t hash;
+           /** Block holding the directory entry. */
+  uint32_t block;
+           /** Entry within the block. */
+  uint8_t  index;
+} __attribute__((packed));
+
+class DirIndex {
+public:
+    enum class State {
+        EMPTY = 0,      /** not built yet, next open of the directory scans it */
+        BUILT = 1,      /** holds every name of the directory */
+        OVERFLOW = 2    /** names did not fit, opens scan the directory */
+    };
+
+    DirIndex(dir_index_entry_t *entries, uint16_t capacity);
+    void clear();
+    State get_state();
+    void set_state(State state);
+
+    uint16_t find(uint16_t hash, uint16_t from);
+    dir_index_entry_t* get(uint16_t slot);
+    bool add(uint16_t hash, uint32_t block, uint8_t index);
+    void remove(uint32_t block, uint8_t index);
+
+    static uint16_t hash(const uint8_t *name);
+
+    static uint16_t const FREE = 0;      // hash of a free directory entry
+    static uint16_t const NONE = 0XFFFF; // find() result if nothing matches
+
+private:
+    friend class FAT;
+
+    dir_index_entry_t *entries;
+    uint16_t capacity;
+    uint16_t count;
+    State state;
+    uint32_t cluster;   // first cluster of the indexed directory
+    DirIndex *next;     // next index known to the volume
+
+};
+
+#endif /* _DIRINDEX_H_ */
@@ -0,0 +1,53 @@
+/**
+ * @file DirIterator.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Directory walker handing out raw entries with a resumable position.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DIRITERATOR_H_
+#define _DIRITERATOR_H_
+
+#include <File.h>
+
+class DirIterator {
+public:
+    DirIterator(File &dir, uint8_t options);
+
+    dir_t* next();
+    bool is_end();
+    void rewind();
+    uint32_t get_cookie();
+    bool seek(uint32_t cookie);
+    void get_name(const dir_t *p, char *buffer);
+
+private:
+    File *dir;
+    uint8_t options;    // File::LS_FILE and/or File::LS_FOLDER
+    uint32_t cookie;    // directory position of the next entry to look at
+    bool end;           // last next() found no more entries, not an error
+
+};
+
+#endif /* _DIRITERATOR_H_ */
@@ -30,8 +30,53 @@
 #ifndef _FAT_H_
 #define _FAT_H_
 
-#include <SDCard.h> // For now the only option
+#include <BlockDevice.h>
 #include <FatStructs.h>
+#include <DirIndex.h>
+
+/**
+ * Number of 512 byte blocks held by the FAT block cache.
+ * Define FAT_CACHE_STATS to count cache hits and misses.
+ */
+#ifndef FAT_CACHE_SLOTS
+#if defined(__AVR_ATmega2560__) || !defined(__AVR__)
+#define FAT_CACHE_SLOTS 4
+#else
+#define FAT_CACHE_SLOTS 1
+#endif
+#endif
+
+/**
+ * Size in bytes of the free cluster summary. Each bit covers a group of
+ * clusters and is cleared once the allocator found the group full.
+ */
+#ifndef FAT_FREE_MAP_BYTES
+#if defined(__AVR_ATmega2560__) || !defined(__AVR__)
+#define FAT_FREE_MAP_BYTES 64
+#else
+#define FAT_FREE_MAP_BYTES 16
+#endif
+#endif
+
+/**
+ * Number of directories remembered by path lookups, so opening files under
+ * the same directory again does not search every level. Zero disables it.
+ */
+#ifndef FAT_DENTRY_SLOTS
+#if defined(__AVR_ATmega2560__) || !defined(__AVR__)
+#define FAT_DENTRY_SLOTS 4
+#else
+#define FAT_DENTRY_SLOTS 0
+#endif
+#endif
+
+/**
+ * Define FAT_ONLY_FAT16 or FAT_ONLY_FAT32 if all volumes have one format.
+ * The FAT code for the other type is then left out and mount() rejects it.
+ */
+#if defined(FAT_ONLY_FAT16) && defined(FAT_ONLY_FAT32)
+#error "Define only one of FAT_ONLY_FAT16 and FAT_ONLY_FAT32"
+#endif
 
 union cache_t {
            /** Used to access cached file data blocks. */
@@ -46,8 +91,67 @@ union cache_t {
   mbr_t    mbr;
            /** Used to access to a cached FAT boot sector. */
   fbs_t    fbs;
+           /** Used to access a cached FAT32 FSINFO sector. */
+  fsinfo_t fsinfo;
 };
 
+struct cache_slot_t {
+           /** Cached block contents. */
+  cache_t  buffer;
+           /** Device block held by this slot, 0XFFFFFFFF if none. */
+  uint32_t block_no;
+           /** Second FAT copy of this block to write on flush, 0 if none. */
+  uint32_t mirror_block;
+           /** Block changed since it was read. */
+  bool     dirty;
+           /** Slot may not be evicted while non zero. */
+  uint8_t  pins;
+};
+
+struct dentry_t {
+           /** First cluster of the parent directory, 0 for the FAT16 root. */
+  uint32_t parent;
+           /** 8.3 name as stored in the directory entry. */
+  uint8_t  name[11];
+           /** First cluster of the directory, 0 if slot unused. */
+  uint32_t cluster;
+           /** Block holding the directory entry. */
+  uint32_t dir_block;
+           /** Entry within the block. */
+  uint8_t  dir_index;
+};
+
+/**
+ * Volume layout saved by FAT::get_snapshot() and restored by
+ * FAT::mount(const fat_snapshot_t*) to skip the mount time scans.
+ * It holds only the geometry. The free count and the next free hint
+ * change with every write, possibly on another machine, so a snapshot
+ * mount reads them from FSINFO like mount() does.
+ */
+struct fat_snapshot_t {
+           /** FAT_SNAPSHOT_MAGIC if the snapshot was taken. */
+  uint16_t magic;
+           /** Volume serial number of the boot sector. */
+  uint32_t serial;
+           /** Block of the boot sector. */
+  uint32_t boot_block;
+           /** Total blocks of the volume as in the boot sector. */
+  uint32_t total_blocks;
+  uint8_t  fat_count;
+  uint8_t  blocks_per_cluster;
+  uint8_t  cluster_size_shift;
+  uint8_t  fat_type;
+  uint32_t blocks_per_fat;
+  uint32_t fat_start_block;
+  uint16_t root_dir_entry_cnt;
+  uint32_t root_dir_start;
+  uint32_t data_start_block;
+  uint32_t cluster_count;
+  uint32_t fsinfo_block;
+           /** Makes the byte sum of the snapshot 0XFF. */
+  uint8_t  check;
+} __attribute__((packed));
+
 class FAT {
 public:
     enum class Type {
@@ -56,8 +160,10 @@ public:
         F32 = 32
     };
 
-    FAT(SDCard *dev);
+    FAT(BlockDevice *dev);
     bool mount();
+    bool mount(const fat_snapshot_t *snap);
+    bool get_snapshot(fat_snapshot_t *snap);
     Type get_type();
     uint32_t get_cluster_count();
     uint8_t get_blocks_per_cluster();
@@ -67,38 +173,125 @@ public:
     uint32_t get_root_entry_count();
     uint32_t get_root_start();
     bool get_chain_size(uint32_t cluster, uint32_t *size);
+
+    /**
+     * @brief Walks a chain a FAT sector at a time to its last cluster.
+     * 
+     * @details cluster is set to the last cluster and count to the clusters
+     * in the chain. contiguous tells if every cluster follows the one before.
+     */
+    bool get_chain_end(uint32_t *cluster, uint32_t *count, bool *contiguous);
+    bool get_root_size(uint32_t *size);
+    void set_root_size(uint32_t size);
     uint8_t get_block(uint32_t position);
     uint32_t get_start_block(uint32_t cluster);
     uint32_t get_cache_block_no();
 
     bool read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *buffer);
+    bool read_blocks(uint32_t block, uint16_t count, uint8_t *buffer);
     uint8_t* get_buffer_data_ptr();
     dir_t* get_buffer_dir_ptr();
 
     bool flush_cache();
+    bool sync();
+    bool unmount();
+    int32_t free_clusters();
+
+    /**
+     * @brief Remembers where path lookups found directories.
+     * 
+     * @details Entries are only dropped by mount, as directories are never
+     * removed through this library. Volumes changed elsewhere need a new
+     * mount.
+     */
+    dentry_t* dentry_find(uint32_t parent, const uint8_t *name);
+    void dentry_add(const dentry_t *dentry);
+
+    /**
+     * @brief Name indexes of directories, see File::set_index().
+     * 
+     * @details The volume keeps them by the first cluster of the directory,
+     * so every handle of that directory uses and updates the same index.
+     * Mount forgets them.
+     */
+    void add_dir_index(DirIndex *index, uint32_t cluster);
+    void remove_dir_index(DirIndex *index);
+    DirIndex* find_dir_index(uint32_t cluster);
+    void dir_index_drop(uint32_t block, uint8_t index);
+
+    /**
+     * @brief Delays copying FAT sectors to the secondary FAT until sync.
+     * 
+     * @details Changed FAT sectors are remembered in a bitmap over a window
+     * of 32 sectors and copied once by sync() or unmount(), or when a change
+     * falls outside the window. Until then only the primary FAT is current.
+     * A power loss before sync leaves the secondary FAT stale but the primary
+     * FAT consistent with the directory, as FAT drivers only read the primary
+     * FAT and a disk check repairs the copy.
+     */
+    bool set_deferred_mirror(bool enable);
+
     bool is_eoc(uint32_t cluster);
     uint8_t get_cluster_size_shift();
     bool free_chain(uint32_t cluster);
     bool put_eoc(uint32_t cluster);
     bool alloc_contiguous(uint32_t count, uint32_t *current_cluster);
+    bool alloc_aligned(uint32_t *current_cluster);
+    bool set_alloc_unit(uint32_t blocks);
     bool cache_zero_block(uint32_t block_no);
-    void set_cache_block_no(uint32_t block_no);
+    bool zero_blocks(uint32_t first_block, uint32_t last_block);
+    void set_discard(bool enable);
+    bool is_cached(uint32_t block_no);
+
+    /**
+     * @brief Drops cached copies of blocks about to be written on the device.
+     * 
+     * @details Fails and keeps the range cached if a block in it is pinned.
+     * The caller must then write through the cache instead.
+     */
+    bool cache_invalidate(uint32_t first_block, uint32_t last_block);
+
+    /**
+     * @brief Caches a block and keeps it from being evicted until unpin_block().
+     * 
+     * @details Fails if every slot is pinned. With a single slot, no other
+     * block can be cached while one is pinned.
+     */
+    bool pin_block(uint32_t block_no, uint8_t action);
+    void unpin_block(uint32_t block_no);
 
     bool write_block(uint32_t block, const uint8_t *dst);
+
+    /**
+     * @brief Writes one block of a run of count blocks starting at block.
+     * 
+     * @details Starting a run pre-erases at most owned blocks from block on,
+     * as blocks pre-erased but not written are left undefined by the card.
+     */
+    bool write_multiple(uint32_t block, const uint8_t *src, uint16_t count, uint32_t owned);
     void set_cache_dirty();
 
+#ifdef FAT_CACHE_STATS
+    uint32_t get_cache_hits();
+    uint32_t get_cache_misses();
+#endif
 
     static uint8_t const CACHE_FOR_READ = 0;   // value for action argument in cacheRawBlock to indicate read from cache
     static uint8_t const CACHE_FOR_WRITE = 1;   // value for action argument in cacheRawBlock to indicate cache dirty
+    static uint8_t const CACHE_OPTION_NO_READ = 2;   // action option to skip reading a block that will be overwritten
+    static uint8_t const CACHE_RESERVE_FOR_WRITE = CACHE_FOR_WRITE | CACHE_OPTION_NO_READ;
 
 
 private:
-    SDCard *dev;
+    BlockDevice *dev;
 
-    uint32_t cache_block_no;
-    bool cache_dirty;
-    cache_t buffer;
-    uint32_t cache_mirror_block;
+    cache_slot_t cache[FAT_CACHE_SLOTS];
+    cache_slot_t *current;                  // slot of the last cached block
+    uint8_t cache_lru[FAT_CACHE_SLOTS];     // slot indexes, most recently used first
+#ifdef FAT_CACHE_STATS
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+#endif
 
     uint8_t fat_count;
     uint8_t blocks_per_cluster;
@@ -111,8 +304,60 @@ private:
     uint32_t cluster_count;
     Type fat_type;
     uint32_t alloc_search_start;
+    uint32_t au_first_cluster;
+    uint32_t au_clusters;
+    bool au_full;           // last search found no free AU and no cluster was freed since
+    bool discard;
+    bool deferred_mirror;
+    uint32_t mirror_base;   // first FAT sector of the deferred mirror window
+    uint32_t mirror_map;    // FAT sectors of the window waiting to be mirrored
+    uint8_t free_map[FAT_FREE_MAP_BYTES];   // clear bit - cluster group has no free cluster
+    uint8_t free_group_shift;               // clusters per free_map bit as power of 2
+    uint32_t fsinfo_block;  // FAT32 FSINFO sector, 0 if none
+    uint32_t free_count;    // free clusters, FSINFO_UNKNOWN if not known
+    bool fsinfo_dirty;      // free_count or alloc_search_start not yet in FSINFO
+    uint32_t boot_block;    // block of the volume boot sector
+    uint32_t root_size;     // bytes in FAT32 root chain, 0 if not known
+#if FAT_DENTRY_SLOTS
+    dentry_t dentries[FAT_DENTRY_SLOTS];    // most recently used first
+#endif
+    DirIndex *dir_indexes;  // list of directory name indexes
+
+    /** True for 16 bit FAT entries, constant in single type builds. */
+    bool is_fat16()
+    {
+#if defined(FAT_ONLY_FAT16)
+        return true;
+#elif defined(FAT_ONLY_FAT32)
+        return false;
+#else
+        return fat_type == Type::F16;
+#endif
+    }
 
     bool put_fat(uint32_t cluster, uint32_t value);
+    bool cache_fat(uint32_t cluster, uint8_t action);
+    uint8_t fat_entry_shift();
+    uint32_t fat_entry(uint32_t cluster);
+    void store_fat(uint32_t cluster, uint32_t value);
+    uint32_t find_free(uint32_t first, uint32_t last);
+    uint32_t find_free_run(uint32_t first, uint32_t last);
+    bool follow_chain(uint32_t *cluster, uint32_t *count);
+    bool discard_clusters(uint32_t first, uint32_t last);
+    bool cache_write_back(cache_slot_t *slot);
+    void cache_touch(uint8_t index);
+    bool mirror_fat(uint32_t sector);
+    bool flush_mirror();
+    void free_map_init();
+    bool free_map_test(uint32_t cluster);
+    void free_map_mark(uint32_t cluster, bool may_free);
+    bool read_fsinfo();
+    void mount_reset();
+    uint32_t get_serial();
+    static uint8_t snapshot_sum(const fat_snapshot_t *snap);
+
+    static uint16_t const FAT_SNAPSHOT_MAGIC = 0XFA02;
+    bool write_fsinfo();
 
 
 };
@@ -288,6 +288,44 @@ uint32_t const FAT32MASK = 0X0FFFFFFF;
 /** Type name for fat32BootSector */
 typedef struct fat32BootSector fbs_t;
 //------------------------------------------------------------------------------
+/** Value for leadSignature of FSINFO */
+uint32_t const FSINFO_LEAD_SIG = 0X41615252;
+/** Value for structSignature of FSINFO */
+uint32_t const FSINFO_STRUCT_SIG = 0X61417272;
+/** Value of freeCount and nextFree when unknown */
+uint32_t const FSINFO_UNKNOWN = 0XFFFFFFFF;
+/**
+ * \struct fat32FSInfo
+ *
+ * \brief FSINFO sector of a FAT32 volume.
+ *
+ * Hints kept by the driver to avoid scanning the FAT.
+ */
+struct fat32FSInfo {
+           /** must be 0X41615252 */
+  uint32_t leadSignature;
+           /** must be zero */
+  uint8_t  reserved1[480];
+           /** must be 0X61417272 */
+  uint32_t structSignature;
+          /**
+           * Last known free cluster count on the volume, 0XFFFFFFFF if
+           * unknown. Not necessarily correct.
+           */
+  uint32_t freeCount;
+          /**
+           * Cluster number at which the driver should start looking for
+           * free clusters, 0XFFFFFFFF if unknown.
+           */
+  uint32_t nextFree;
+           /** must be zero */
+  uint8_t  reserved2[12];
+           /** must be 0X00, 0X00, 0X55, 0XAA */
+  uint8_t  tailSignature[4];
+} __attribute__((packed));
+/** Type name for fat32FSInfo */
+typedef struct fat32FSInfo fsinfo_t;
+//------------------------------------------------------------------------------
 /**
  * \struct directoryEntry
  * \brief FAT short directory entry
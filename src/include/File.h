@@ -32,12 +32,44 @@
 
 #include <stdint.h>
 #include <string.h>
+#ifdef __AVR__
 #include <avr/pgmspace.h>
+#else
+// host builds keep the name filter in RAM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#endif
 #include <stdio.h>
 #include <ctype.h>
 #include <FAT.h>
+#include <DirIndex.h>
+
+/**
+ * Number of cluster runs each open file remembers so seeks and reads can
+ * find clusters without walking the FAT. Zero disables the extent map.
+ */
+#ifndef FILE_EXTENT_SLOTS
+#if defined(__AVR_ATmega2560__) || !defined(__AVR__)
+#define FILE_EXTENT_SLOTS 4
+#else
+#define FILE_EXTENT_SLOTS 0
+#endif
+#endif
+
+struct extent_t {
+           /** Index in the file of the first cluster of the run. */
+  uint32_t index;
+           /** Volume cluster holding that file cluster. */
+  uint32_t cluster;
+           /** Contiguous clusters in the run, 0 if slot unused. */
+  uint32_t count;
+};
 
 class File {
+    friend class DirIterator;
+    friend class TreeWalker;
+
 public:
 
     enum class Type {
@@ -67,6 +99,7 @@ public:
         O_CREAT = 0X10,   /** create the file if nonexistent */
         O_EXCL = 0X20,    /** If O_CREAT and O_EXCL are set, open() shall fail if the file exists */
         O_TRUNC = 0X40,   /** truncate the file to zero length */
+        O_ALIGN = 0X80,   /** start a new file on a card allocation unit boundary */
 
         // flags for timestamp
         T_ACCESS = 1, /** set the file's last access date */
@@ -75,7 +108,8 @@ public:
 
         // bits defined in flags_    
         F_OFLAG = (O_ACCMODE | O_APPEND | O_SYNC), // should be 0XF
-        F_UNUSED = 0X30, // available bits
+        F_FILE_ALIGN = 0X10, // allocate first cluster on an allocation unit
+        F_FILE_PREALLOC = 0X20, // clusters reserved past end of file, trim on close
         F_FILE_UNBUFFERED_READ = 0X40,   // use unbuffered SD read
         F_FILE_DIR_DIRTY = 0X80 // sync of directory entry required
     };
@@ -87,22 +121,30 @@ public:
     File(FAT *fs);
     File(File f, const char *name);
     bool open_root();
+    void set_index(DirIndex *index);
     bool ls(char *buffer, uint8_t options);
     bool ls(char *buffer, uint8_t options, uint8_t index);
     bool is_dir();
 
     int16_t read(uint8_t *buffer, uint16_t size);
     int16_t read();
+    int16_t read_view(const uint8_t **data);
+    bool consume(uint16_t count);
 
     bool is_open();
     bool is_file();
 
     bool open(File &dir, const char *filename, uint8_t oflag);
+    bool open(const char *path, uint8_t oflag);
     bool close();
     bool sync();
     static bool make83name(const char *str, uint8_t *name);
 
     uint32_t get_current_position();
+    bool seek_set(uint32_t pos);
+    bool seek_end();
+    bool preallocate(uint32_t bytes);
+    bool is_contiguous();
     uint32_t get_file_size();
     Type get_type();
     bool add_dir_cluster();
@@ -122,24 +164,39 @@ private:
     uint32_t first_cluster;
     uint32_t file_size;
     uint8_t flags;
+    bool contiguous;    // all clusters consecutive, valid if contiguous_known
+    bool contiguous_known;  // false until the chain of an opened file is walked
 
     uint32_t current_cluster;
     uint32_t current_position;
     uint32_t dir_block;
     uint8_t dir_index;
+#if FILE_EXTENT_SLOTS
+    extent_t extents[FILE_EXTENT_SLOTS];
+#endif
  
     dir_t* read_dir_cache();
     uint8_t is_unbuffered_read();
+    bool current_block(uint32_t *block, uint8_t *run);
 
-    bool fill_name(dir_t* p, char* buffer, uint8_t options);    
+    bool fill_name(const dir_t* p, char* buffer, uint8_t options);    
 
     dir_t* cache_dir_entry(uint8_t action);
     bool open_cached_entry(uint8_t dir_index, uint8_t oflag);
+    bool create_entry(dir_t *p, const uint8_t *dname, uint8_t oflag);
+    bool open_dir(File &dir, const char *name);
+    bool build_index(DirIndex *index);
+    bool index_find(DirIndex *index, const uint8_t *dname, uint16_t hash, dir_t **entry);
+    bool index_take_free(DirIndex *index, uint16_t hash, dir_t **entry);
     bool truncate(uint32_t length);
-    bool seek_set(uint32_t pos);
     bool add_cluster();
-    bool seek_end();
+    void extent_reset();
+    uint32_t extent_find(uint32_t index, uint32_t *cluster);
+    void extent_add(uint32_t index, uint32_t cluster);
+    uint32_t extent_run(uint32_t index);
 
+    /** Directory size before its chain was followed to the end */
+    static uint32_t const DIR_SIZE_UNKNOWN = 0XFFFFFFFF;
     /** Default date for file timestamps is 1 Jan 2000 */
     static uint16_t const FAT_DEFAULT_DATE = ((2000 - 1980) << 9) | (1 << 5) | 1;
     /** Default time for file timestamp is 1 am */
@@ -0,0 +1,123 @@
+/**
+ * @file ImageDisk.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Block device backed by a disk image file, for host builds.
+ * 
+ * @details Lets the filesystem run on a development machine against an
+ * image of a formatted card. The block transfer counters are meant for
+ * regression tests and benchmarks.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IMAGEDISK_H_
+#define _IMAGEDISK_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+class ImageDisk {
+public:
+    ImageDisk(const char *path);
+    bool init();
+    void close();
+    uint32_t get_block_count();
+
+    bool read_block(uint32_t block, uint8_t *dst);
+    bool read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *dst);
+    bool read_blocks(uint32_t block, uint16_t count, uint8_t *dst);
+
+    bool write_block(uint32_t block, const uint8_t *src);
+    bool write_start(uint32_t block, uint32_t erase_count);
+    bool write_next(const uint8_t *src);
+    bool write_stop();
+    bool is_write_next(uint32_t block);
+    bool sync();
+
+    bool erase(uint32_t first_block, uint32_t last_block);
+    uint8_t get_erase_value();
+    uint16_t get_erase_size();
+
+    uint32_t get_read_count();
+    uint32_t get_write_count();
+    uint32_t get_command_count();
+    void clear_counters();
+
+    /**
+     * @brief Fails every read of this block, as a card returning a data
+     * error token does. NO_BLOCK reads every block again.
+     */
+    void set_bad_block(uint32_t block);
+    static const uint32_t NO_BLOCK = 0XFFFFFFFF;
+
+    /**
+     * @brief Counts the allocation unit merges of an SD card with AUs of
+     * this many blocks, 0 turns the model off.
+     * 
+     * @details The card keeps AU_OPEN units open for writing. Writing to
+     * another one closes the least recently written. Closing a unit copies
+     * every block of it that was not written in order from its first block,
+     * as a card merging a partly or randomly written AU does.
+     */
+    void set_au_model(uint32_t blocks);
+
+    /**
+     * @brief Closes every open AU, so the counters include their merges.
+     */
+    void close_aus();
+
+    uint32_t get_au_merges();   // AUs closed with blocks to copy
+    uint32_t get_au_copies();   // blocks copied by those merges
+
+private:
+    const char *path;
+    FILE *image;
+    uint32_t block_count;
+    uint32_t write_block_no;
+    bool in_write_multiple;
+    uint32_t bad_block;
+
+    uint32_t read_count;    // blocks read
+    uint32_t write_count;   // blocks written
+    uint32_t command_count; // equivalent SD card commands issued
+
+    struct open_au_t {
+        uint32_t au;        // AU number, NO_AU if the slot is unused
+        uint32_t written;   // blocks written in order from the first block
+        bool in_order;      // no block written out of that order
+    };
+    static const uint8_t AU_OPEN = 4;
+    static const uint32_t NO_AU = 0XFFFFFFFF;
+
+    uint32_t au_blocks;
+    open_au_t open_aus[AU_OPEN];    // most recently written first
+    uint32_t au_merges;
+    uint32_t au_copies;
+
+    bool seek(uint32_t block, uint16_t offset);
+    void au_write(uint32_t block);
+    void au_close(open_au_t *au);
+
+};
+
+#endif /* _IMAGEDISK_H_ */
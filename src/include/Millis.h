@@ -10,6 +10,11 @@
  * Copyright (c) 2018 Angelo Elias Dalzotto & Gabriel Boni Vicari
  * 
  * @brief The Millis class manages the milliseconds timer.
+ * 
+ * @details Define MILLIS_TICKLESS to run TIMER2 free without its 1kHz
+ * interrupt. Time is then only accounted when get() is called, which must
+ * happen at least every 16ms (at 16MHz) while an interval is measured,
+ * as the polling loops of Deadline do.
  */
 
 #ifndef _MILLIS_H_
@@ -58,6 +63,44 @@ public:
 private:
     static bool initialized;
     static uint32_t counter;
+#ifdef MILLIS_TICKLESS
+    static uint8_t last_count;
+    static uint32_t fraction;
+#endif
+};
+
+/**
+ * Deadline class
+ */
+class Deadline {
+public:
+
+    /**
+     * @brief Starts the deadline.
+     * 
+     * @param milliseconds Time until expired() returns true.
+     * @param interval Calls to expired() per clock read. Loops where each
+     * poll is a whole command and may block on its own should pass 1.
+     */
+    Deadline(uint16_t milliseconds, uint8_t interval = POLL_INTERVAL);
+
+    /**
+     * @brief Polls the deadline.
+     * 
+     * @details The clock is only read once every interval calls, so with the
+     * default interval this is cheap enough for spin loops that poll the SPI bus.
+     * 
+     * @returns true if the time is over.
+     */
+    bool expired();
+
+private:
+    static const uint8_t POLL_INTERVAL = 32;
+
+    uint32_t start;
+    uint16_t timeout;
+    uint8_t interval;
+    uint8_t polls;
 };
 
 #endif /* _MILLIS_H_ */
\ No newline at end of file
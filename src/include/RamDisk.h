@@ -0,0 +1,63 @@
+/**
+ * @file RamDisk.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Block device kept in a caller supplied RAM buffer.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RAMDISK_H_
+#define _RAMDISK_H_
+
+#include <stdint.h>
+#include <string.h>
+
+class RamDisk {
+public:
+    RamDisk(uint8_t *data, uint32_t block_count);
+    uint32_t get_block_count();
+
+    bool read_block(uint32_t block, uint8_t *dst);
+    bool read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *dst);
+    bool read_blocks(uint32_t block, uint16_t count, uint8_t *dst);
+
+    bool write_block(uint32_t block, const uint8_t *src);
+    bool write_start(uint32_t block, uint32_t erase_count);
+    bool write_next(const uint8_t *src);
+    bool write_stop();
+    bool is_write_next(uint32_t block);
+    bool sync();
+
+    bool erase(uint32_t first_block, uint32_t last_block);
+    uint8_t get_erase_value();
+    uint16_t get_erase_size();
+
+private:
+    uint8_t *data;
+    uint32_t block_count;
+    uint32_t write_block_no;
+    bool in_write_multiple;
+
+};
+
+#endif /* _RAMDISK_H_ */
@@ -65,18 +65,113 @@ public:
         WRITE_PROGRAMMING = 0X14, /** card returned an error to a CMD13 status check after a write */
         WRITE_TIMEOUT = 0X15,     /** timeout occurred during write programming */
         SCK_RATE = 0X16,          /** incorrect rate selected */
+        CMD12 = 0X17,     /** card returned an error response for CMD12 (stop transmission) */
+        CMD18 = 0X18,     /** card returned an error response for CMD18 (read multiple blocks) */
+    };
+
+    struct Info {
+        uint32_t blocks;        /** card capacity in 512 byte blocks */
+        uint32_t max_clock;     /** maximum transfer rate from CSD TRAN_SPEED, in Hz */
+        uint16_t erase_size;    /** erase sector size in 512 byte blocks */
+        bool erase_single;      /** card can erase single blocks */
+        uint8_t manufacturer;   /** CID manufacturer ID */
+        char oem[3];            /** CID OEM/application ID */
+        char product[6];        /** CID product name */
+        uint8_t revision;       /** CID product revision, BCD n.m */
+        uint32_t serial;        /** CID product serial number */
+        uint16_t year;          /** CID manufacturing year */
+        uint8_t month;          /** CID manufacturing month */
+        uint32_t au_size;       /** SD Status allocation unit size in 512 byte blocks, 0 if unknown */
+        uint16_t erase_au_count;    /** SD Status number of AUs erased within erase_timeout */
+        uint8_t erase_timeout;  /** SD Status erase timeout in seconds for erase_au_count AUs */
+        uint8_t erase_offset;   /** SD Status erase timeout offset in seconds */
+        uint8_t erase_value;    /** SCR DATA_STAT_AFTER_ERASE, byte value of erased blocks */
     };
 
     SDCard(volatile uint8_t *port_cs, volatile uint8_t *ddr_cs, uint8_t pin_cs);
     bool init();
     Type get_type();
     Error get_error();
+    const Info &info();
+    uint8_t get_erase_value();
+
+    /**
+     * @returns Blocks that erase() ranges must be aligned to, 1 if the card
+     * erases single blocks.
+     */
+    uint16_t get_erase_size();
 
     bool write_block(uint32_t block_no, const uint8_t* src);
-    bool read_block(uint32_t block, uint8_t *dst);
+    bool write_start(uint32_t block_no, uint32_t erase_count);
+    bool write_next(const uint8_t* src);
+    bool write_stop();
+    bool is_write_next(uint32_t block_no);
+
+    /**
+     * @brief Selects when write_block() waits for flash programming.
+     * 
+     * @details When deferred, write_block() returns as soon as the card
+     * accepts the data. The busy wait moves to the next command, poll_ready()
+     * or sync(), and the CMD13 status check of all writes since the last
+     * check is done once by sync(). A write that does not finish programming
+     * makes every command fail until the card is ready again, and sync()
+     * reports it as Error::WRITE_TIMEOUT. A write that programmed with an
+     * error is reported by sync() as Error::WRITE_PROGRAMMING.
+     */
+    void set_deferred_write(bool enable);
+
+    /**
+     * @returns true if the card is not programming a deferred write. Never blocks.
+     */
+    bool poll_ready();
+
+    /**
+     * @brief Waits for all writes to complete and checks the card status.
+     */
+    bool sync();
 
+    bool read_block(uint32_t block, uint8_t *dst);
     bool read_data(uint32_t block, uint16_t offset, uint16_t count, uint8_t *dst);
 
+    bool read_blocks(uint32_t block, uint16_t count, uint8_t *dst);
+    bool read_start(uint32_t block);
+    bool read_next(uint8_t *dst);
+    bool read_stop();
+
+    bool erase(uint32_t first_block, uint32_t last_block);
+
+    /**
+     * @brief Starts reading a block into dst in the background.
+     * 
+     * @details The command and the wait for the data token run before this
+     * returns, the 512 data bytes are then moved by the SPI interrupt. dst
+     * must stay valid and unused until finish_async() returns. The callback,
+     * if any, runs in interrupt context when the last byte arrived and must
+     * not use the SPI bus or this card.
+     */
+    bool read_block_async(uint32_t block, uint8_t *dst, SPI::Callback callback);
+
+    /**
+     * @brief Starts writing src to a block in the background.
+     * 
+     * @details Same rules as read_block_async(), src must not change until
+     * finish_async() returns. The data response and programming are checked
+     * by finish_async().
+     */
+    bool write_block_async(uint32_t block_no, const uint8_t *src, SPI::Callback callback);
+
+    /**
+     * @returns true while the interrupt is still moving data. Never blocks.
+     */
+    bool is_async_busy();
+
+    /**
+     * @brief Waits for the background transfer and completes its protocol.
+     * 
+     * @details Any other command runs this first. If the transfer failed,
+     * that command fails as well.
+     */
+    bool finish_async();
 
 private:
     volatile uint8_t *PORT_CS;
@@ -89,22 +184,44 @@ private:
     Type type;
     uint32_t block;
     uint8_t partial_block_read;
+    uint8_t in_read_multiple;
+    uint8_t in_write_multiple;
+    uint32_t write_block_no;
+    uint8_t async_op;
+    Info card_info;
+    bool deferred_write;
+    uint8_t write_pending;
+    uint8_t status_pending;
 
     void deselect();
     void select();
     uint8_t send_cmd(uint8_t cmd, uint32_t arg);
     void end_read();
-    bool wait_busy(uint32_t milliseconds);
+    bool wait_busy(uint16_t milliseconds);
     uint8_t send_acmd(uint8_t cmd, uint32_t arg);
 
     bool write_data(uint8_t token, const uint8_t* src);
+    bool write_response();
+    bool wait_programmed();
+    bool wait_write();
 
     bool wait_start_block();
+    bool read_register(uint8_t cmd, uint8_t *dst);
+    bool parse_csd(const uint8_t *csd);
+    void parse_cid(const uint8_t *cid);
+    bool read_sd_status();
+    bool read_scr();
 
     
     static const uint16_t SD_INIT_TIMEOUT = 2000;
     static const uint16_t SD_WRITE_TIMEOUT = 600;
     static const uint16_t SD_READ_TIMEOUT = 300;
+    static const uint16_t SD_ERASE_TIMEOUT = 10000;
+
+    // asynchronous operation in progress
+    static const uint8_t ASYNC_NONE = 0;
+    static const uint8_t ASYNC_READ = 1;
+    static const uint8_t ASYNC_WRITE = 2;
 
 
     // SD card commands
@@ -112,8 +229,10 @@ private:
     static const uint8_t CMD8 = 0x08;   /** SEND_IF_COND - verify SD Memory Card interface operating condition.*/
     static const uint8_t CMD9 = 0X09;   /** SEND_CSD - read the Card Specific Data (CSD register) */
     static const uint8_t CMD10 = 0X0A;  /** SEND_CID - read the card identification information (CID register) */    
+    static const uint8_t CMD12 = 0X0C;  /** STOP_TRANSMISSION - end multiple block read sequence */
     static const uint8_t CMD13 = 0X0D;  /** SEND_STATUS - read the card status register */
     static const uint8_t CMD17 = 0X11;  /** READ_BLOCK - read a single data block from the card */
+    static const uint8_t CMD18 = 0X12;  /** READ_MULTIPLE_BLOCK - read blocks of data until a STOP_TRANSMISSION */
     static const uint8_t CMD24 = 0X18;  /** WRITE_BLOCK - write a single data block to the card */
     static const uint8_t CMD25 = 0X19;  /** WRITE_MULTIPLE_BLOCK - write blocks of data until a STOP_TRANSMISSION */
     static const uint8_t CMD32 = 0X20;  /** ERASE_WR_BLK_START - sets the address of the first block to be erased */
@@ -121,7 +240,9 @@ private:
     static const uint8_t CMD38 = 0X26;  /** ERASE - erase all previously selected blocks */
     static const uint8_t CMD55 = 0X37;  /** APP_CMD - escape for application specific command */
     static const uint8_t CMD58 = 0X3A;  /** READ_OCR - read the OCR register of a card */
+    static const uint8_t ACMD13 = 0X0D; /** SD_STATUS - read the SD Status register */
     static const uint8_t ACMD23 = 0X17; /** SET_WR_BLK_ERASE_COUNT - Set the number of write blocks to be pre-erased before writing */
+    static const uint8_t ACMD51 = 0X33; /** SEND_SCR - read the SD Configuration Register */
     static const uint8_t ACMD41 = 0X29; /** SD_SEND_OP_COMD - Sends host capacity support information and activates the card's initialization process */
     
     static const uint8_t R1_READY_STATE = 0X00;         /** status for card in the ready state */
@@ -29,18 +29,73 @@
 #define _SPI_H_
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+
+/**
+ * SPI transfer complete interrupt service.
+ * It clocks the asynchronous block transfer.
+ */
+extern "C" void SPI_STC_vect(void) __attribute__((signal));
 
 class SPI {
 public:
+    /** Called from the SPI ISR when an asynchronous transfer completes */
+    typedef void (*Callback)();
+
     static void init(volatile uint8_t *DDR_SS, volatile uint8_t *DDR_SCK, volatile uint8_t *DDR_MOSI, volatile uint8_t *DDR_MISO,
                      uint8_t PIN_SS, uint8_t PIN_SCK, uint8_t PIN_MOSI, uint8_t PIN_MISO, volatile uint8_t *PORT_SS);
     static void write(uint8_t data);
     static uint8_t read();
-    static void set_speed();
+    static void set_speed(uint32_t max_hz);
+
+    /**
+     * @brief Sends a buffer, loading each byte while the previous one shifts out.
+     */
+    static void send_block(const uint8_t *src, uint16_t count);
+
+    /**
+     * @brief Receives a buffer, starting each transfer before storing the previous byte.
+     */
+    static void receive_block(uint8_t *dst, uint16_t count);
+
+    /**
+     * @brief Starts clocking a buffer out in the background.
+     * 
+     * @details The transfer is driven by the SPI interrupt, so global
+     * interrupts must be enabled. No other SPI call may be made until
+     * is_busy() returns false.
+     */
+    static void send_async(const uint8_t *src, uint16_t count, Callback callback);
+
+    /**
+     * @brief Starts clocking a buffer in the background.
+     * 
+     * @details Same rules as send_async(). 0xFF is sent for every byte.
+     */
+    static void receive_async(uint8_t *dst, uint16_t count, Callback callback);
+
+    /**
+     * @returns true while an asynchronous transfer is in progress.
+     */
+    static bool is_busy();
+
+    /**
+     * @brief SPI ISR declaration.
+     * 
+     * @details This is done to include the ISR in the class.
+     * This is not to be called.
+     */
+    friend void SPI_STC_vect(void);
 
 private:
     static bool initialized;
 
+    static uint8_t *async_ptr;
+    static uint16_t async_left;
+    static bool async_rx;
+    static Callback async_callback;
+    static volatile bool async_busy;
+
 };
 
 
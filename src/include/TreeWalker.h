@@ -0,0 +1,69 @@
+/**
+ * @file TreeWalker.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Depth first walk of a directory tree without recursion.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TREEWALKER_H_
+#define _TREEWALKER_H_
+
+#include <File.h>
+
+class TreeWalker {
+public:
+    enum class Event {
+        FILE = 0,       /** a file of the current directory */
+        DIR_ENTER = 1,  /** a subdirectory, before its contents */
+        DIR_LEAVE = 2   /** a subdirectory, after its contents */
+    };
+
+    /**
+     * Return false to stop the walk. p is the entry for FILE and DIR_ENTER.
+     * It is nullptr for DIR_LEAVE, when get_dir() is the directory left.
+     */
+    typedef bool (*visitor_t)(TreeWalker &walker, const dir_t *p, Event event, void *arg);
+
+    TreeWalker(File *levels, uint8_t depth);
+
+    bool walk(File &dir, uint8_t options, visitor_t visitor, void *arg);
+    uint8_t get_depth();
+    File& get_dir();
+    uint16_t get_skipped();
+    bool open_current(File &file, uint8_t oflag);
+
+private:
+    File *levels;       // one open directory per level below the start
+    uint8_t capacity;
+    uint8_t depth;      // level of the current directory, 0 is the start
+    File *start;
+    uint16_t skipped;   // directories too deep to enter
+    uint32_t entry_block;
+    uint8_t entry_index;
+
+    bool visit(visitor_t visitor, const dir_t *p, Event event, void *arg);
+
+};
+
+#endif /* _TREEWALKER_H_ */
@@ -28,6 +28,7 @@
  */
 
 #include <avr/io.h>
+#include <avr/eeprom.h>
 #include <serial.h>
 #include <SDCard.h>
 #include <FAT.h>
@@ -39,6 +40,10 @@ FAT fs(&disk);
 File root(&fs);
 File file(&fs);
 
+// volume layout from the last boot
+fat_snapshot_t EEMEM snapshot_ee;
+fat_snapshot_t snapshot;
+
 void handle_error()
 {
     switch(disk.get_error()){
@@ -69,15 +74,21 @@ int main()
     printf("Initializing SD card...\n");
     if(disk.init()){
         printf("Card connected!\n");
+        printf("%s %s, %lu blocks, up to %lu Hz\n", disk.info().oem, disk.info().product,
+               disk.info().blocks, disk.info().max_clock);
     } else {
         printf("Card initialization failed.\n");
         handle_error();
     }
-    SPI::set_speed(); // Max speed for now
 
     printf("\nMounting FAT Filesystem...\n");
-    if(fs.mount()){
+    // snapshot skips the mount scans if the card was not changed
+    eeprom_read_block(&snapshot, &snapshot_ee, sizeof(snapshot));
+    if(fs.mount(&snapshot)){
         printf("Filesystem mounted!\n");
+        printf("%ld free clusters\n", (long)fs.free_clusters());
+        // start new large files on card allocation units
+        fs.set_alloc_unit(disk.info().au_size);
     } else {
         printf("Mount error.\n");
         handle_error();
@@ -86,6 +97,10 @@ int main()
     printf("\nOpening filesystem root...\n");
     if(root.open_root()){
         printf("Root is open\n");
+
+        // only changed bytes are written to EEPROM
+        if(fs.get_snapshot(&snapshot))
+            eeprom_update_block(&snapshot, &snapshot_ee, sizeof(snapshot));
     } else {
         printf("Unable to open root\n");
         handle_error();
@@ -0,0 +1,243 @@
+/**
+ * @file FATCardTest.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host tests of the FAT class on the SD card driver against SimCard.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <SimCard.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(x) do { if (!(x)) { \
+    printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #x); failures++; } } while (0)
+
+static char image[256];
+static uint8_t buffer[16384];
+static SDCard card(&PORTB, &DDRB, SimCard::CS_PIN);
+
+static void clear_counts()
+{
+    memset(sim_card.commands, 0, sizeof(sim_card.commands));
+    sim_card.protocol_errors = 0;
+}
+
+static void fill(uint32_t first, uint32_t last)
+{
+    memset(&sim_card.data[first * 512], 0X5A, (last - first + 1) * 512);
+}
+
+static bool is_zero(uint32_t first, uint32_t last)
+{
+    for (uint32_t i = first * 512; i < (last + 1) * 512; i++)
+        if (sim_card.data[i])
+            return false;
+    return true;
+}
+
+// puts an empty FAT16 volume on the card
+static bool load_volume(bool single_erase)
+{
+    uint32_t blocks;
+    if (!TestImage::format(image, SimCard::BLOCKS / 2048, 16, 1))
+        return false;
+    uint8_t *data = TestImage::load(image, &blocks);
+    if (!data)
+        return false;
+    sim_card.reset();
+    memcpy(sim_card.data, data, blocks * 512);
+    delete[] data;
+    sim_card.no_single_erase = !single_erase;
+    return card.init();
+}
+
+static void test_zero_erase()
+{
+    CHECK(load_volume(true));
+    FAT fs(&card);
+    CHECK(fs.mount());
+
+    // the card erases single blocks to zero, no block is written
+    uint32_t block = fs.get_start_block(100);
+    fill(block, block + 9);
+    clear_counts();
+    CHECK(fs.zero_blocks(block + 1, block + 8));
+    CHECK(fs.sync());
+    CHECK(sim_card.commands[38] == 1);
+    CHECK(sim_card.commands[24] == 0 && sim_card.commands[25] == 0);
+    CHECK(is_zero(block + 1, block + 8));
+    CHECK(sim_card.data[block * 512] == 0X5A && sim_card.data[(block + 9) * 512] == 0X5A);
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static void test_zero_fallback()
+{
+    CHECK(load_volume(false));
+    CHECK(card.get_erase_size() == 128);
+    FAT fs(&card);
+    CHECK(fs.mount());
+
+    // a range the card cannot erase is written with zeros, without a failed erase
+    uint32_t block = fs.get_start_block(100);
+    fill(block, block + 9);
+    clear_counts();
+    CHECK(fs.zero_blocks(block + 1, block + 8));
+    CHECK(fs.sync());
+    CHECK(sim_card.commands[32] == 0 && sim_card.commands[38] == 0);
+    CHECK(card.get_error() == SDCard::Error::OK);
+    CHECK(is_zero(block + 1, block + 8));
+    CHECK(sim_card.data[block * 512] == 0X5A && sim_card.data[(block + 9) * 512] == 0X5A);
+
+    // whole erase sectors still go to the card
+    uint32_t aligned = (block + 127) & ~127UL;
+    fill(aligned, aligned + 127);
+    clear_counts();
+    CHECK(fs.zero_blocks(aligned, aligned + 127));
+    CHECK(sim_card.commands[38] == 1);
+    CHECK(is_zero(aligned, aligned + 127));
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static uint32_t discard_first;
+static uint32_t discard_last;
+static bool discard_freed;
+
+// the FAT entries of the discarded clusters are free on the card when it erases
+static void check_freed()
+{
+    mbr_t *mbr = (mbr_t*)sim_card.data;
+    uint32_t start = mbr->part[0].firstSector;
+    bpb_t *bpb = &((fbs_t*)&sim_card.data[start * 512])->bpb;
+    uint32_t fat = start + bpb->reservedSectorCount;
+    for (uint8_t n = 0; n < bpb->fatCount; n++) {
+        uint16_t *entries = (uint16_t*)&sim_card.data[(fat + n * bpb->sectorsPerFat16) * 512];
+        for (uint32_t c = discard_first; c <= discard_last; c++)
+            if (entries[c])
+                discard_freed = false;
+    }
+}
+
+static void test_discard()
+{
+    CHECK(load_volume(false));
+    FAT fs(&card);
+    CHECK(fs.mount());
+    fs.set_discard(true);
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    CHECK(f.open(root, "TRIM.BIN", File::O_CREAT | File::O_WRITE));
+    memset(buffer, 0X5A, sizeof(buffer));
+    for (uint16_t i = 0; i < 400; i++)
+        CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.sync());
+
+    // the file took the first clusters, only the erase sectors inside them are erased
+    uint32_t start = fs.get_start_block(2);
+    uint32_t end = start + 400;
+    uint32_t aligned = (start + 127) & ~127UL;
+    clear_counts();
+    discard_first = 2;
+    discard_last = 401;
+    discard_freed = true;
+    sim_card.on_erase = check_freed;
+    CHECK(f.rm());
+    sim_card.on_erase = nullptr;
+    CHECK(discard_freed);
+    CHECK(fs.sync());
+    CHECK(sim_card.commands[38] == 1);
+    CHECK(card.get_error() == SDCard::Error::OK);
+    CHECK(is_zero(aligned, (end & ~127UL) - 1));
+    CHECK(sim_card.data[(aligned - 1) * 512] == 0X5A);
+    CHECK(sim_card.data[(end & ~127UL) * 512] == 0X5A);
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static void test_pre_erase()
+{
+    CHECK(load_volume(true));
+    FAT fs(&card);
+    CHECK(fs.mount());
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    memset(buffer, 'A', 512);
+    CHECK(f.open(root, "A.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    memset(buffer, 'B', 512);
+    CHECK(f.open(root, "B.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+
+    // B.BIN follows the only cluster of A.BIN, rewriting A.BIN must not pre-erase it
+    memset(buffer, 'a', 4096);
+    sim_card.pre_erase = 0;
+    CHECK(f.open(root, "A.BIN", File::O_WRITE));
+    CHECK(f.write(buffer, 4096) == 4096);
+    CHECK(f.close());
+    CHECK(sim_card.pre_erase == 0);
+    CHECK(f.open(root, "B.BIN", File::O_READ));
+    memset(buffer, 0, 512);
+    CHECK(f.read(buffer, 512) == 512);
+    CHECK(buffer[0] == 'B' && buffer[511] == 'B');
+    CHECK(f.close());
+
+    // preallocated clusters are known to follow, the whole request is pre-erased
+    CHECK(f.open(root, "C.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.preallocate(32768));
+    memset(buffer, 'C', 16384);
+    CHECK(f.write(buffer, 16384) == 16384);
+    CHECK(sim_card.pre_erase == 32);
+    CHECK(f.close());
+    CHECK(f.open(root, "C.BIN", File::O_READ));
+    memset(buffer, 0, 16384);
+    CHECK(f.read(buffer, 16384) == 16384);
+    CHECK(buffer[0] == 'C' && buffer[16383] == 'C');
+    CHECK(f.close());
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+int main(int argc, char **argv)
+{
+    snprintf(image, sizeof(image), "%s.img", argv[0]);
+
+    test_zero_erase();
+    test_zero_fallback();
+    test_discard();
+    test_pre_erase();
+
+    remove(image);
+    if (failures)
+        printf("FATCardTest: %d failures\n", failures);
+    else
+        printf("FATCardTest: passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,613 @@
+/**
+ * @file FATTest.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host tests of the FAT and File classes on disk image files.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <TreeWalker.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(x) do { if (!(x)) { \
+    printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #x); failures++; } } while (0)
+
+static char image[256];
+static uint8_t buffer[4096];
+
+static void test_pinned_block()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    CHECK(f.open(root, "PIN.BIN", File::O_CREAT | File::O_RDWR));
+    memset(buffer, 'A', 512);
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.sync());
+
+    // the file takes the first cluster after the root
+    uint32_t block = fs.get_start_block(3);
+    CHECK(fs.pin_block(block, FAT::CACHE_FOR_READ));
+    const uint8_t *pinned = fs.get_buffer_data_ptr();
+    CHECK(pinned[0] == 'A');
+
+    // the pinned copy stays cached and takes the writes meant for the device
+    CHECK(!fs.cache_invalidate(block, block));
+    CHECK(fs.is_cached(block));
+    memset(buffer, 'B', 512);
+    CHECK(f.seek_set(0));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(pinned[0] == 'B' && pinned[511] == 'B');
+    CHECK(fs.zero_blocks(block, block));
+    CHECK(pinned[0] == 0 && pinned[511] == 0);
+
+    fs.unpin_block(block);
+    CHECK(fs.cache_invalidate(block, block));
+    CHECK(!fs.is_cached(block));
+    CHECK(f.close());
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static void test_deferred_mirror()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+    CHECK(fs.set_deferred_mirror(true));
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    CHECK(f.open(root, "LOG.BIN", File::O_CREAT | File::O_WRITE));
+    for (uint16_t i = 0; i < 64; i++)
+        CHECK(f.write(buffer, 1000) == 1000);
+
+    // a synced volume has every FAT copy up to date, the file still open
+    CHECK(f.sync());
+    CHECK(TestImage::check(image) == 0);
+    CHECK(f.close());
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static void test_align_full()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+    CHECK(fs.set_alloc_unit(64));
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    CHECK(f.open(root, "HOLE.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    CHECK(f.open(root, "FILL.BIN", File::O_CREAT | File::O_WRITE));
+    while (f.write(buffer, 512) == 512);
+    CHECK(f.close());
+
+    // no free AU and no free cluster, the file stays empty
+    CHECK(f.open(root, "FULL.BIN", File::O_CREAT | File::O_WRITE | File::O_ALIGN));
+    CHECK(f.write(buffer, 512) == 0);
+    CHECK(f.close());
+
+    // no free AU, the file takes the only free cluster
+    CHECK(f.open(root, "HOLE.BIN", File::O_WRITE));
+    CHECK(f.rm());
+    CHECK(f.open(root, "NEW.BIN", File::O_CREAT | File::O_WRITE | File::O_ALIGN));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.write(buffer, 512) == 0);
+    CHECK(f.close());
+    CHECK(fs.free_clusters() == 0);
+
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static void test_align_sectors()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+    CHECK(fs.set_alloc_unit(256));
+
+    // first AU after the root, it spans three FAT sectors
+    uint32_t au = 3;
+    while (fs.get_start_block(au) % 256)
+        au++;
+
+    // a cluster in use in the last sector of that AU
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    CHECK(f.open(root, "SPAN.BIN", File::O_CREAT | File::O_WRITE));
+    for (uint32_t c = 3; c < au + 200; c++)
+        CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    CHECK(f.open(root, "USED.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    uint32_t value;
+    CHECK(fs.get_fat(au + 200, &value) && fs.is_eoc(value));
+    CHECK(f.open(root, "SPAN.BIN", File::O_WRITE));
+    CHECK(f.rm());
+
+    // the aligned file skips to the next AU
+    CHECK(f.open(root, "NEW.BIN", File::O_CREAT | File::O_WRITE | File::O_ALIGN));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    CHECK(fs.get_fat(au, &value) && value == 0);
+    CHECK(fs.get_fat(au + 256, &value) && fs.is_eoc(value));
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static void test_align_no_free_au()
+{
+    CHECK(TestImage::format(image, 16, 16, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+    CHECK(fs.set_alloc_unit(64));
+
+    // every other cluster free, each AU half used
+    File root(&fs);
+    root.open_root();
+    File a(&fs);
+    File b(&fs);
+    CHECK(a.open(root, "A.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(b.open(root, "B.BIN", File::O_CREAT | File::O_WRITE));
+    while (a.write(buffer, 512) == 512 && b.write(buffer, 512) == 512);
+    CHECK(a.close());
+    CHECK(b.rm());
+    CHECK(fs.sync());
+
+    // the first create searches the whole FAT, later ones take any free cluster
+    File f(&fs);
+    disk.clear_counters();
+    CHECK(f.open(root, "N0.BIN", File::O_CREAT | File::O_WRITE | File::O_ALIGN));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    CHECK(disk.get_read_count() > 100);
+    char name[13];
+    for (uint8_t i = 1; i < 8; i++) {
+        snprintf(name, sizeof(name), "N%u.BIN", i);
+        disk.clear_counters();
+        CHECK(f.open(root, name, File::O_CREAT | File::O_WRITE | File::O_ALIGN));
+        CHECK(f.write(buffer, 512) == 512);
+        CHECK(f.close());
+        CHECK(disk.get_read_count() <= 2);
+    }
+
+    // freed clusters make the next create search again, and find an AU
+    CHECK(a.open(root, "A.BIN", File::O_WRITE));
+    CHECK(a.rm());
+    CHECK(f.open(root, "NEW.BIN", File::O_CREAT | File::O_WRITE | File::O_ALIGN));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    uint32_t value;
+    uint32_t aligned = 0;
+    for (uint32_t c = 3; c < fs.get_cluster_count() + 2; c++) {
+        CHECK(fs.get_fat(c, &value));
+        if (value && fs.get_start_block(c) % 64 == 0)
+            aligned++;
+    }
+    CHECK(aligned == 1);
+
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static void test_preallocate_chain()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    File g(&fs);
+    CHECK(f.open(root, "A.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.write(buffer, 1024) == 1024);
+    CHECK(f.preallocate(1024));
+    CHECK(f.is_contiguous());
+
+    // another file splits the chain
+    CHECK(g.open(root, "B.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(g.write(buffer, 512) == 512);
+    CHECK(g.close());
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.preallocate(300 * 512UL));
+    CHECK(!f.is_contiguous());
+
+    // 2 clusters, the one of B.BIN, then the other 298
+    uint32_t cluster = 3;
+    uint32_t count = 0;
+    bool contiguous;
+    CHECK(fs.get_chain_end(&cluster, &count, &contiguous));
+    CHECK(count == 300 && !contiguous && cluster == 303);
+
+    CHECK(f.write(buffer, 4096) == 4096);
+    CHECK(f.close());
+
+    // opened files walk their chain when asked, without preallocate()
+    CHECK(f.open(root, "B.BIN", File::O_READ));
+    CHECK(f.is_contiguous());
+    CHECK(f.close());
+    CHECK(f.open(root, "A.BIN", File::O_READ));
+    CHECK(!f.is_contiguous());
+    CHECK(f.close());
+    CHECK(g.open(root, "C.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(g.write(buffer, 4096) == 4096);
+    CHECK(g.close());
+    CHECK(g.open(root, "C.BIN", File::O_WRITE | File::O_APPEND));
+    CHECK(g.write(buffer, 512) == 512);
+    CHECK(g.is_contiguous());
+    CHECK(g.close());
+
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static void test_snapshot()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    fat_snapshot_t snap;
+    int32_t free_before;
+    {
+        FAT fs(&disk);
+        CHECK(fs.mount());
+        CHECK(fs.get_snapshot(&snap));
+        free_before = fs.free_clusters();
+    }
+    {
+        // card written elsewhere after the snapshot was taken
+        FAT fs(&disk);
+        CHECK(fs.mount());
+        File root(&fs);
+        root.open_root();
+        File f(&fs);
+        CHECK(f.open(root, "OTHER.BIN", File::O_CREAT | File::O_WRITE));
+        CHECK(f.write(buffer, sizeof(buffer)) == sizeof(buffer));
+        CHECK(f.close());
+        CHECK(fs.unmount());
+    }
+
+    // the boot sector and FSINFO are the only reads
+    FAT fs(&disk);
+    disk.clear_counters();
+    CHECK(fs.mount(&snap));
+    CHECK(disk.get_read_count() == 2);
+    CHECK(fs.free_clusters() == free_before - 8);
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    CHECK(f.open(root, "LOG.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static void test_short_chain()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    CHECK(f.open(root, "SHORT.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.write(buffer, 2048) == 2048);
+    CHECK(f.close());
+
+    // chain of the file's 4 clusters ends after the second one
+    CHECK(fs.put_eoc(4));
+    CHECK(f.open(root, "SHORT.BIN", File::O_READ));
+    CHECK(f.read(buffer, 2048) == -1);
+    CHECK(f.get_file_size() == 2048);
+    const uint8_t *data;
+    CHECK(f.read_view(&data) == -1);
+    CHECK(f.get_file_size() == 2048);
+    CHECK(f.close());
+}
+
+static void test_dir_index()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+
+    static dir_index_entry_t entries[64];
+    static DirIndex index(entries, 64);
+    File indexed(&fs);
+    indexed.open_root();
+    indexed.set_index(&index);
+    File f(&fs);
+    CHECK(f.open(indexed, "A.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.close());
+    CHECK(index.get_state() == DirIndex::State::BUILT);
+
+    // creates and removes through other handles of the root
+    File root(&fs);
+    root.open_root();
+    CHECK(f.open(root, "B.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.close());
+    CHECK(f.open("/C.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.close());
+    CHECK(f.open(root, "A.BIN", File::O_WRITE));
+    CHECK(f.rm());
+
+    // the index knows about all of them
+    CHECK(!f.open(indexed, "B.BIN", File::O_CREAT | File::O_WRITE | File::O_EXCL));
+    CHECK(!f.open(indexed, "C.BIN", File::O_CREAT | File::O_WRITE | File::O_EXCL));
+    CHECK(!f.open(indexed, "A.BIN", File::O_READ));
+    CHECK(f.open(indexed, "A.BIN", File::O_CREAT | File::O_WRITE | File::O_EXCL));
+    CHECK(f.close());
+    CHECK(f.open(root, "B.BIN", File::O_READ));
+    CHECK(f.close());
+
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static uint8_t count_entries(ImageDisk *disk, uint32_t block, const char *dname)
+{
+    uint8_t count = 0;
+    CHECK(disk->read_block(block, buffer));
+    for (uint16_t i = 0; i < 512; i += 32)
+        if (!memcmp(&buffer[i], dname, 11))
+            count++;
+    return count;
+}
+
+static void test_index_read_error()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+
+    static dir_index_entry_t entries[64];
+    static DirIndex index(entries, 64);
+    File indexed(&fs);
+    indexed.open_root();
+    indexed.set_index(&index);
+    File f(&fs);
+    CHECK(f.open(indexed, "A.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.close());
+    CHECK(index.get_state() == DirIndex::State::BUILT);
+
+    // fills the first root block and frees an entry in the second
+    char name[13];
+    for (uint8_t i = 0; i < 16; i++) {
+        snprintf(name, sizeof(name), "F%u.BIN", i);
+        CHECK(f.open(indexed, name, File::O_CREAT | File::O_WRITE));
+        CHECK(f.close());
+    }
+    CHECK(f.open(indexed, "F15.BIN", File::O_WRITE));
+    CHECK(f.rm());
+    CHECK(fs.sync());
+
+    // the block holding the name can't be read, the free entry must not be taken
+    uint32_t block = fs.get_start_block(fs.get_root_start());
+    uint32_t next = fs.get_start_block(fs.get_root_start() + 1);
+    CHECK(count_entries(&disk, next, "F15     BIN") == 0);
+    CHECK(fs.cache_invalidate(block, block));
+    disk.set_bad_block(block);
+    CHECK(!f.open(indexed, "A.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(!f.is_open());
+    disk.set_bad_block(ImageDisk::NO_BLOCK);
+
+    CHECK(fs.sync());
+    CHECK(count_entries(&disk, block, "A       BIN") == 1);
+    CHECK(count_entries(&disk, next, "A       BIN") == 0);
+    CHECK(f.open(indexed, "A.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.close());
+    CHECK(count_entries(&disk, next, "A       BIN") == 0);
+
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+static void test_open_path()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    CHECK(TestImage::add_path(image, "A/B/C/D"));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+
+    File f(&fs);
+    CHECK(f.open("/A/B/C/D/FILE.TXT", File::O_READ));
+    CHECK(f.is_file());
+    CHECK(f.close());
+    CHECK(f.open("A//B/C/D/", File::O_READ));
+    CHECK(f.is_dir());
+    CHECK(f.close());
+
+    // five directory blocks do not fit the block cache, the dentries skip four
+    disk.clear_counters();
+    CHECK(f.open("/A/B/C/D/FILE.TXT", File::O_READ));
+    CHECK(disk.get_read_count() == 0);
+    CHECK(f.close());
+
+    // files are created under the cached directories
+    CHECK(f.open("/A/B/C/D/NEW.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.write(buffer, 512) == 512);
+    CHECK(f.close());
+    File d(&fs);
+    CHECK(d.open("/A/B/C/D", File::O_READ));
+    CHECK(f.open(d, "NEW.BIN", File::O_READ));
+    CHECK(f.get_file_size() == 512);
+    CHECK(f.close());
+
+    CHECK(!f.open("/A/X/C/D/FILE.TXT", File::O_READ));
+    CHECK(!f.open("/A/B/C/D/FILE.TXT/X", File::O_READ));
+    CHECK(!f.open("/A/B/C/D/FILE.TXT/X", File::O_CREAT | File::O_WRITE));
+    CHECK(!f.open("/A/FILENAME.TXTX/C", File::O_READ));
+    CHECK(!f.open("/A/B/C/D/FILENAME.TXTX", File::O_CREAT | File::O_WRITE));
+    CHECK(!f.is_open());
+
+    // a new mount forgets every directory
+    uint8_t name[11];
+    CHECK(File::make83name("A", name));
+    CHECK(fs.dentry_find(2, name) && fs.dentry_find(2, name)->cluster == 2000);
+    CHECK(fs.mount());
+    CHECK(!fs.dentry_find(2, name));
+    CHECK(File::make83name("D", name));
+    CHECK(!fs.dentry_find(2002, name));
+    disk.clear_counters();
+    CHECK(f.open("/A/B/C/D/FILE.TXT", File::O_READ));
+    CHECK(disk.get_read_count() == 5);
+    CHECK(f.close());
+
+    // the least recently used directory makes room for a new one
+    dentry_t extra;
+    memset(&extra, 0, sizeof(extra));
+    extra.parent = 2;
+    memcpy(extra.name, "E          ", 11);
+    extra.cluster = 3000;
+    fs.dentry_add(&extra);
+    CHECK(fs.dentry_find(2, extra.name) && fs.dentry_find(2, extra.name)->cluster == 3000);
+    CHECK(File::make83name("A", name));
+    CHECK(!fs.dentry_find(2, name));
+    CHECK(File::make83name("B", name));
+    CHECK(fs.dentry_find(2000, name));
+
+    CHECK(fs.unmount());
+    disk.close();
+    CHECK(TestImage::check(image) == 0);
+}
+
+struct walk_counts {
+    uint16_t files;
+    uint16_t enters;
+    uint16_t leaves;
+};
+
+static bool count_entry(TreeWalker &walker, const dir_t *p, TreeWalker::Event event, void *arg)
+{
+    walk_counts *counts = (walk_counts*)arg;
+    if (event == TreeWalker::Event::FILE && p)
+        counts->files++;
+    else if (event == TreeWalker::Event::DIR_ENTER && p)
+        counts->enters++;
+    else if (event == TreeWalker::Event::DIR_LEAVE && !p && walker.get_depth() == 1)
+        counts->leaves++;
+    return true;
+}
+
+static void test_tree_walk()
+{
+    CHECK(TestImage::format(image, 64, 32, 1));
+    CHECK(TestImage::add_dir(image, "BIG", 40));
+    ImageDisk disk(image);
+    disk.init();
+    FAT fs(&disk);
+    CHECK(fs.mount());
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    CHECK(f.open(root, "TOP.BIN", File::O_CREAT | File::O_WRITE));
+    CHECK(f.close());
+
+    // the second walk reuses the level the first one left open
+    File levels[1] = {&fs};
+    TreeWalker walker(levels, 1);
+    for (uint8_t i = 0; i < 2; i++) {
+        walk_counts counts = {0, 0, 0};
+        CHECK(walker.walk(root, File::LS_FILE | File::LS_FOLDER | File::LS_R, count_entry, &counts));
+        CHECK(counts.files == 41 && counts.enters == 1 && counts.leaves == 1);
+        CHECK(levels[0].is_open());
+    }
+    CHECK(fs.unmount());
+    disk.close();
+}
+
+int main(int argc, char **argv)
+{
+    snprintf(image, sizeof(image), "%s.img", argv[0]);
+
+    test_pinned_block();
+    test_deferred_mirror();
+    test_align_full();
+    test_align_sectors();
+    test_align_no_free_au();
+    test_preallocate_chain();
+    test_snapshot();
+    test_short_chain();
+    test_dir_index();
+    test_index_read_error();
+    test_tree_walk();
+    test_open_path();
+
+    remove(image);
+    if (failures)
+        printf("FATTest: %d failures\n", failures);
+    else
+        printf("FATTest: passed\n");
+    return failures != 0;
+}
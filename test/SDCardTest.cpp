@@ -0,0 +1,387 @@
+/**
+ * @file SDCardTest.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host tests of the SD card driver against SimCard.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <SDCard.h>
+#include <SimCard.h>
+#include <stdio.h>
+#include <string.h>
+
+static int failures = 0;
+
+#define CHECK(x) do { if (!(x)) { \
+    printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #x); failures++; } } while (0)
+
+static SDCard card(&PORTB, &DDRB, SimCard::CS_PIN);
+static uint8_t buffer[16 * 512];
+
+static void fill(uint32_t block, uint16_t count, uint8_t seed)
+{
+    for (uint32_t i = 0; i < count * 512UL; i++)
+        sim_card.data[block * 512 + i] = (uint8_t)(i * 7 + seed + (i >> 9));
+}
+
+static bool same(uint32_t block, uint16_t count, const uint8_t *src)
+{
+    return !memcmp(&sim_card.data[block * 512], src, count * 512UL);
+}
+
+static void clear_counts()
+{
+    memset(sim_card.commands, 0, sizeof(sim_card.commands));
+    sim_card.protocol_errors = 0;
+}
+
+static void test_init()
+{
+    CHECK(card.init());
+    CHECK(card.get_type() == SDCard::Type::SDHC);
+    CHECK(card.info().blocks == SimCard::BLOCKS);
+    CHECK(card.info().max_clock == 25000000UL);
+}
+
+static void test_read_blocks()
+{
+    fill(100, 16, 1);
+    clear_counts();
+    CHECK(card.read_blocks(100, 16, buffer));
+    CHECK(same(100, 16, buffer));
+    CHECK(sim_card.commands[18] == 1);
+    CHECK(sim_card.commands[12] == 1);
+    CHECK(sim_card.commands[17] == 0);
+    CHECK(!sim_card.in_read_multiple());
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static void test_read_session()
+{
+    fill(200, 3, 2);
+    clear_counts();
+    CHECK(card.read_start(200));
+    for (uint8_t i = 0; i < 3; i++)
+        CHECK(card.read_next(buffer + i * 512));
+    CHECK(card.read_stop());
+    CHECK(same(200, 3, buffer));
+    CHECK(sim_card.commands[18] == 1 && sim_card.commands[12] == 1);
+
+    // a new command ends an open session
+    CHECK(card.read_start(200));
+    CHECK(card.read_next(buffer));
+    CHECK(card.read_block(201, buffer));
+    CHECK(same(201, 1, buffer));
+    CHECK(sim_card.commands[12] == 2);
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static void test_read_error()
+{
+    fill(300, 4, 3);
+    sim_card.read_error_block = 302;
+    clear_counts();
+    CHECK(!card.read_blocks(300, 4, buffer));
+    CHECK(card.get_error() == SDCard::Error::READ);
+
+    // the failed session was stopped
+    CHECK(sim_card.commands[12] == 1);
+    CHECK(!sim_card.in_read_multiple());
+    sim_card.read_error_block = SimCard::NONE;
+    CHECK(card.read_block(302, buffer));
+    CHECK(same(302, 1, buffer));
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static void test_write_session()
+{
+    uint8_t src[4 * 512];
+    for (uint16_t i = 0; i < sizeof(src); i++)
+        src[i] = (uint8_t)(i * 3 + 5);
+
+    clear_counts();
+    uint32_t stops = sim_card.stop_tokens;
+    CHECK(card.write_start(500, 4));
+    for (uint8_t i = 0; i < 4; i++)
+        CHECK(card.write_next(src + i * 512));
+    CHECK(card.write_stop());
+    CHECK(same(500, 4, src));
+    CHECK(sim_card.commands[25] == 1 && sim_card.commands[23] == 1);
+    CHECK(sim_card.stop_tokens == stops + 1);
+
+    // a new command ends an open session
+    CHECK(card.write_start(510, 0));
+    CHECK(card.write_next(src));
+    CHECK(card.read_block(510, buffer));
+    CHECK(!memcmp(buffer, src, 512));
+    CHECK(sim_card.stop_tokens == stops + 2);
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static void test_write_reject()
+{
+    uint8_t src[512];
+    memset(src, 0X5A, sizeof(src));
+    sim_card.write_reject_block = 602;
+    clear_counts();
+    uint32_t stops = sim_card.stop_tokens;
+    CHECK(card.write_start(600, 0));
+    CHECK(card.write_next(src));
+    CHECK(card.write_next(src));
+    CHECK(!card.write_next(src));
+    CHECK(card.get_error() == SDCard::Error::WRITE);
+
+    // the session was ended with a stop token
+    CHECK(sim_card.stop_tokens == stops + 1);
+    CHECK(!sim_card.in_write_multiple());
+    sim_card.write_reject_block = SimCard::NONE;
+    CHECK(card.write_block(602, src));
+    CHECK(same(602, 1, src));
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static void test_stop_timeout()
+{
+    uint8_t src[512];
+    memset(src, 0XA5, sizeof(src));
+    clear_counts();
+    CHECK(card.write_start(700, 0));
+    CHECK(card.write_next(src));
+
+    // card never finishes the stop token, the next command must not go out
+    sim_card.stuck_busy = true;
+    CHECK(!card.read_block(700, buffer));
+    CHECK(sim_card.commands[17] == 0);
+    CHECK(sim_card.protocol_errors == 0);
+
+    sim_card.stuck_busy = false;
+    sim_card.busy = 0;
+    CHECK(card.read_block(700, buffer));
+    CHECK(!memcmp(buffer, src, 512));
+}
+
+static void test_deferred_timeout()
+{
+    uint8_t src[512];
+    memset(src, 0X3C, sizeof(src));
+    card.set_deferred_write(true);
+
+    // the write returns before the card is done, the next command finds it stuck
+    sim_card.stuck_busy = true;
+    CHECK(card.write_block(900, src));
+    clear_counts();
+    CHECK(!card.read_block(900, buffer));
+    CHECK(sim_card.commands[17] == 0);
+    CHECK(sim_card.protocol_errors == 0);
+
+    // a busy card reads as zeros, the status check must not go out either
+    CHECK(!card.sync());
+    CHECK(card.get_error() == SDCard::Error::WRITE_TIMEOUT);
+    CHECK(sim_card.commands[13] == 0);
+
+    sim_card.stuck_busy = false;
+    sim_card.busy = 0;
+    CHECK(card.sync());
+    CHECK(card.read_block(900, buffer));
+    CHECK(!memcmp(buffer, src, 512));
+    card.set_deferred_write(false);
+}
+
+static void test_deferred_sync()
+{
+    uint8_t src[512];
+    memset(src, 0XC3, sizeof(src));
+    card.set_deferred_write(true);
+
+    // sync waits for the write itself
+    sim_card.stuck_busy = true;
+    CHECK(card.write_block(910, src));
+    CHECK(!card.sync());
+    CHECK(card.get_error() == SDCard::Error::WRITE_TIMEOUT);
+    sim_card.stuck_busy = false;
+    sim_card.busy = 0;
+
+    // one status check after several writes
+    sim_card.status_error = true;
+    clear_counts();
+    CHECK(card.write_block(911, src));
+    CHECK(card.write_block(912, src));
+    CHECK(sim_card.commands[13] == 0);
+    CHECK(!card.sync());
+    CHECK(card.get_error() == SDCard::Error::WRITE_PROGRAMMING);
+    CHECK(sim_card.commands[13] == 1);
+    sim_card.status_error = false;
+
+    // nothing left to check
+    CHECK(card.sync());
+    CHECK(sim_card.commands[13] == 1);
+    CHECK(sim_card.protocol_errors == 0);
+    card.set_deferred_write(false);
+}
+
+static void test_poll_ready()
+{
+    uint8_t src[512];
+    memset(src, 0X69, sizeof(src));
+    card.set_deferred_write(true);
+
+    sim_card.stuck_busy = true;
+    CHECK(card.write_block(920, src));
+    uint32_t start = Millis::get();
+    for (uint8_t i = 0; i < 100; i++)
+        CHECK(!card.poll_ready());
+    CHECK(Millis::get() - start <= 1);
+
+    sim_card.stuck_busy = false;
+    sim_card.busy = 0;
+    CHECK(card.poll_ready());
+    CHECK(card.sync());
+    CHECK(same(920, 1, src));
+    CHECK(sim_card.protocol_errors == 0);
+    card.set_deferred_write(false);
+}
+
+static void test_erase()
+{
+    fill(1000, 8, 6);
+    clear_counts();
+    CHECK(card.get_erase_value() == 0);
+    CHECK(card.get_erase_size() == 1);
+    CHECK(card.erase(1001, 1006));
+    CHECK(sim_card.commands[32] == 1 && sim_card.commands[33] == 1 && sim_card.commands[38] == 1);
+    CHECK(card.read_blocks(1000, 8, buffer));
+    CHECK(buffer[0] != 0 && buffer[7 * 512] != 0);
+    for (uint16_t i = 512; i < 7 * 512; i++)
+        CHECK(buffer[i] == 0);
+
+    // without single block erase only whole erase sectors are taken
+    sim_card.no_single_erase = true;
+    CHECK(card.init());
+    CHECK(card.get_erase_size() == 128);
+    fill(1024, 128, 7);
+    clear_counts();
+    CHECK(!card.erase(1025, 1151));
+    CHECK(card.get_error() == SDCard::Error::ERASE_SINGLE_BLOCK);
+    CHECK(sim_card.commands[32] == 0);
+    CHECK(card.erase(1024, 1151));
+    CHECK(card.read_blocks(1024, 16, buffer));
+    CHECK(buffer[0] == 0 && buffer[16 * 512 - 1] == 0);
+    CHECK(sim_card.protocol_errors == 0);
+
+    sim_card.no_single_erase = false;
+    CHECK(card.init());
+}
+
+static uint8_t callbacks;
+
+static void on_done()
+{
+    callbacks++;
+}
+
+static void test_async_read()
+{
+    fill(800, 1, 4);
+    memset(buffer, 0, 512);
+    callbacks = 0;
+
+    // interrupts are held back to see the transfer in progress
+    sim_card.defer_irq = true;
+    CHECK(card.read_block_async(800, buffer, on_done));
+    CHECK(card.is_async_busy());
+    sim_spi_interrupts(100);
+    CHECK(card.is_async_busy());
+    CHECK(callbacks == 0);
+    sim_spi_interrupts(1000);
+    CHECK(!card.is_async_busy());
+    CHECK(callbacks == 1);
+    sim_card.defer_irq = false;
+
+    CHECK(card.finish_async());
+    CHECK(same(800, 1, buffer));
+}
+
+static void test_async_write()
+{
+    uint8_t src[512];
+    for (uint16_t i = 0; i < sizeof(src); i++)
+        src[i] = (uint8_t)(i ^ 0X33);
+    callbacks = 0;
+
+    CHECK(card.write_block_async(810, src, on_done));
+    CHECK(callbacks == 1);
+    CHECK(card.finish_async());
+    CHECK(same(810, 1, src));
+
+    // a rejected block fails the next command if nobody finished it
+    sim_card.write_reject_block = 811;
+    clear_counts();
+    CHECK(card.write_block_async(811, src, nullptr));
+    CHECK(!card.read_block(810, buffer));
+    CHECK(sim_card.commands[17] == 0);
+    sim_card.write_reject_block = SimCard::NONE;
+
+    CHECK(card.write_block_async(811, src, nullptr));
+    CHECK(card.finish_async());
+    CHECK(card.read_block(811, buffer));
+    CHECK(!memcmp(buffer, src, 512));
+    CHECK(sim_card.protocol_errors == 0);
+}
+
+static void test_init_timeout()
+{
+    // a card holding MISO low costs each command its 300 ms busy wait
+    sim_card.busy = SimCard::FOREVER;
+    uint32_t start = Millis::get();
+    CHECK(!card.init());
+    CHECK(card.get_error() == SDCard::Error::CMD0);
+    CHECK(Millis::get() - start < 2400);
+
+    sim_card.busy = 0;
+    CHECK(card.init());
+}
+
+int main()
+{
+    test_init();
+    test_read_blocks();
+    test_read_session();
+    test_read_error();
+    test_write_session();
+    test_write_reject();
+    test_stop_timeout();
+    test_deferred_timeout();
+    test_deferred_sync();
+    test_poll_ready();
+    test_erase();
+    test_async_read();
+    test_async_write();
+    test_init_timeout();
+
+    if (failures)
+        printf("SDCardTest: %d failures\n", failures);
+    else
+        printf("SDCardTest: passed\n");
+    return failures != 0;
+}
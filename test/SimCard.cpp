@@ -0,0 +1,432 @@
+/**
+ * @file SimCard.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief SD card in SPI mode simulated behind the fake AVR registers, for host tests.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <SimCard.h>
+#include <SPI.h>
+#include <Millis.h>
+#include <string.h>
+
+SimCard sim_card;
+
+SimSPDR SPDR;
+SimSPCR SPCR;
+volatile uint8_t SPSR = 1 << SPIF;
+volatile uint8_t DDRB, PORTB;
+SimTCNT2 TCNT2;
+volatile uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2;
+uint32_t sim_atomic_blocks;
+
+static uint8_t spdr_value;
+static uint8_t spcr_value;
+static uint8_t tcnt2_value;
+
+SimSPDR& SimSPDR::operator=(uint8_t data)
+{
+    spdr_value = sim_card.exchange(data);
+    return *this;
+}
+
+SimSPDR::operator uint8_t() const
+{
+    return spdr_value;
+}
+
+// an enabled interrupt fires for every byte until the ISR disables it
+static void deliver()
+{
+    if(!sim_card.defer_irq)
+        while(spcr_value & (1 << SPIE))
+            SPI_STC_vect();
+}
+
+SimTCNT2& SimTCNT2::operator=(uint8_t value)
+{
+    tcnt2_value = value;
+    return *this;
+}
+
+SimTCNT2::operator uint8_t() const
+{
+    sim_card.timer_reads++;
+    return tcnt2_value;
+}
+
+SimSPCR& SimSPCR::operator=(int value)
+{
+    spcr_value = value;
+    deliver();
+    return *this;
+}
+
+SimSPCR& SimSPCR::operator|=(int bits)
+{
+    spcr_value |= bits;
+    deliver();
+    return *this;
+}
+
+SimSPCR& SimSPCR::operator&=(int bits)
+{
+    spcr_value &= bits;
+    return *this;
+}
+
+SimSPCR::operator uint8_t() const
+{
+    return spcr_value;
+}
+
+void sim_spi_interrupts(uint16_t count)
+{
+    while(count-- && (spcr_value & (1 << SPIE)))
+        SPI_STC_vect();
+}
+
+// register contents of a 4 MB SDHC card
+static const uint8_t csd[16] = {
+    0X40, 0X0E, 0X00, 0X32, 0X5B, 0X59, 0X00, 0X00,
+    0X00, 0X07, 0X7F, 0X80, 0X0A, 0X40, 0X00, 0X01
+};
+static const uint8_t cid[16] = {
+    0X03, 'S', 'D', 'S', 'I', 'M', 'C', 'D',
+    0X10, 0X12, 0X34, 0X56, 0X78, 0X01, 0X4A, 0X01
+};
+static const uint8_t scr[8] = { 0X02, 0X35, 0X80, 0X00, 0X00, 0X00, 0X00, 0X00 };
+
+SimCard::SimCard()
+{
+    reset();
+}
+
+void SimCard::reset()
+{
+    memset(data, 0XFF, sizeof(data));
+    read_error_block = NONE;
+    write_reject_block = NONE;
+    stuck_busy = false;
+    status_error = false;
+    no_single_erase = false;
+    defer_irq = false;
+    memset(commands, 0, sizeof(commands));
+    last_command = 0XFF;
+    stop_tokens = 0;
+    protocol_errors = 0;
+    busy = 0;
+    pre_erase = 0;
+    on_erase = nullptr;
+
+    phase = Phase::COMMAND;
+    idle = true;
+    app = false;
+    acmd41 = 0;
+    frame_len = 0;
+    block = 0;
+    multiple = false;
+    stalled = false;
+    rx_len = 0;
+    erase_first = erase_last = 0;
+    erase_count = pre_erase_end = 0;
+    clocked = 0;
+    timer_irqs = 0;
+    timer_reads = 0;
+    out_head = out_len = 0;
+}
+
+bool SimCard::in_read_multiple()
+{
+    return phase == Phase::READ_STREAM;
+}
+
+bool SimCard::in_write_multiple()
+{
+    return multiple && (phase == Phase::WRITE_TOKEN || phase == Phase::WRITE_DATA);
+}
+
+uint8_t SimCard::exchange(uint8_t mosi)
+{
+    // one byte at 8 MHz is 1 us, the timer interrupt runs every ms
+    clocked++;
+#ifndef MILLIS_TICKLESS
+    if(clocked % 1000 == 0 && (TIMSK2 & (1 << OCIE2A))){
+        timer_irqs++;
+        TIMER2_COMPA_vect();
+    }
+#endif
+    // prescaler 1024 ticks every 64 us
+    if(clocked % 64 == 0 && (TCCR2B & 7) == ((1 << CS22) | (1 << CS21) | (1 << CS20)))
+        tcnt2_value++;
+
+    if(PORTB & (1 << CS_PIN))
+        return 0XFF;
+
+    uint8_t miso = pop();
+    receive(mosi);
+    return miso;
+}
+
+void SimCard::push(uint8_t value)
+{
+    out[(out_head + out_len++) % sizeof(out)] = value;
+}
+
+void SimCard::push_packet(const uint8_t *src, uint16_t count)
+{
+    push(0XFF);
+    push(0XFE);
+    for(uint16_t i = 0; i < count; i++)
+        push(src[i]);
+    push(0XFF);
+    push(0XFF);
+}
+
+uint8_t SimCard::pop()
+{
+    if(!out_len && busy){
+        if(busy != FOREVER)
+            busy--;
+        return 0X00;
+    }
+
+    // next block of an open CMD18
+    if(!out_len && phase == Phase::READ_STREAM && !stalled){
+        if(block == read_error_block || block >= BLOCKS){
+            push(0XFF);
+            push(0X08);
+            stalled = true;
+        } else {
+            push_packet(&data[block++ * 512], 512);
+        }
+    }
+
+    if(!out_len)
+        return 0XFF;
+
+    uint8_t value = out[out_head];
+    out_head = (out_head + 1) % sizeof(out);
+    out_len--;
+    return value;
+}
+
+void SimCard::start_busy(uint32_t bytes)
+{
+    busy = stuck_busy ? FOREVER : bytes;
+}
+
+void SimCard::receive(uint8_t mosi)
+{
+    if(phase == Phase::WRITE_TOKEN){
+        if(mosi == (multiple ? 0XFC : 0XFE)){
+            phase = Phase::WRITE_DATA;
+            rx_len = 0;
+        } else if(multiple && mosi == 0XFD){
+            // pre-erased blocks that were not written are left undefined
+            if(block < pre_erase_end && pre_erase_end <= BLOCKS)
+                memset(&data[block * 512], 0X00, (pre_erase_end - block) * 512);
+            pre_erase_end = 0;
+            stop_tokens++;
+            multiple = false;
+            phase = Phase::COMMAND;
+            start_busy(4);
+        } else if((mosi & 0XC0) == 0X40){
+            // a command while the card waits for data
+            protocol_errors++;
+        }
+        return;
+    }
+
+    if(phase == Phase::WRITE_DATA){
+        rx[rx_len++] = mosi;
+        if(rx_len < sizeof(rx))
+            return;
+
+        if(block == write_reject_block || block >= BLOCKS){
+            push(0X0D);
+        } else {
+            memcpy(&data[block * 512], rx, 512);
+            push(0X05);
+        }
+        block++;
+        start_busy(8);
+        phase = multiple ? Phase::WRITE_TOKEN : Phase::COMMAND;
+        return;
+    }
+
+    // collect a six byte command frame
+    if(!frame_len && (mosi & 0XC0) != 0X40)
+        return;
+    frame[frame_len++] = mosi;
+    if(frame_len == sizeof(frame)){
+        frame_len = 0;
+        command();
+    }
+}
+
+void SimCard::command()
+{
+    uint8_t cmd = frame[0] & 0X3F;
+    uint32_t arg = ((uint32_t)frame[1] << 24) | ((uint32_t)frame[2] << 16) |
+                   ((uint16_t)frame[3] << 8) | frame[4];
+    bool acmd = app;
+    app = false;
+    commands[cmd]++;
+    last_command = cmd;
+
+    if(cmd == 12){
+        // stuff byte is whatever data was being sent, then R1
+        if(phase == Phase::READ_STREAM){
+            out_len = 0;
+            push(0X3C);
+            phase = Phase::COMMAND;
+            stalled = false;
+        } else {
+            push(0XFF);
+        }
+        push(0X00);
+        start_busy(2);
+        return;
+    }
+
+    // a busy card or an open CMD18 does not take commands
+    if(busy || phase == Phase::READ_STREAM){
+        protocol_errors++;
+        return;
+    }
+    out_len = 0;
+
+    // response comes after one byte
+    push(0XFF);
+    uint8_t r1 = idle ? 0X01 : 0X00;
+
+    switch(cmd){
+    case 0:
+        idle = true;
+        acmd41 = 0;
+        push(0X01);
+        break;
+    case 8:
+        push(r1);
+        push(0X00);
+        push(0X00);
+        push(0X01);
+        push(0XAA);
+        break;
+    case 55:
+        app = true;
+        push(r1);
+        break;
+    case 41:
+        if(acmd && ++acmd41 >= 2)
+            idle = false;
+        push(idle ? 0X01 : 0X00);
+        break;
+    case 58:
+        push(r1);
+        push(0XC0);
+        push(0XFF);
+        push(0X80);
+        push(0X00);
+        break;
+    case 9: {
+        uint8_t reg[sizeof(csd)];
+        memcpy(reg, csd, sizeof(csd));
+        if(no_single_erase)
+            reg[10] &= ~0X40;
+        push(0X00);
+        push_packet(reg, sizeof(reg));
+        break;
+    }
+    case 10:
+        push(0X00);
+        push_packet(cid, sizeof(cid));
+        break;
+    case 13:
+        push(0X00);
+        if(acmd){
+            push(0X00);
+            uint8_t status[64] = {0};
+            status[10] = 0X90;  // 4 MB AU
+            push_packet(status, sizeof(status));
+        } else {
+            push(status_error ? 0X04 : 0X00);
+        }
+        break;
+    case 51:
+        push(0X00);
+        push_packet(scr, sizeof(scr));
+        break;
+    case 17:
+        push(0X00);
+        if(arg == read_error_block || arg >= BLOCKS){
+            push(0XFF);
+            push(0X08);
+        } else {
+            push_packet(&data[arg * 512], 512);
+        }
+        break;
+    case 18:
+        push(0X00);
+        phase = Phase::READ_STREAM;
+        block = arg;
+        stalled = false;
+        break;
+    case 24:
+    case 25:
+        push(0X00);
+        phase = Phase::WRITE_TOKEN;
+        multiple = cmd == 25;
+        block = arg;
+        pre_erase_end = multiple ? arg + erase_count : 0;
+        erase_count = 0;
+        break;
+    case 23:
+        if(acmd)
+            pre_erase = erase_count = arg;
+        push(0X00);
+        break;
+    case 32:
+        erase_first = arg;
+        push(0X00);
+        break;
+    case 33:
+        erase_last = arg;
+        push(0X00);
+        break;
+    case 38:
+        if(on_erase)
+            on_erase();
+        // erased blocks read as zeros, the SCR has DATA_STAT_AFTER_ERASE clear
+        if(erase_first <= erase_last && erase_last < BLOCKS)
+            memset(&data[erase_first * 512], 0X00, (erase_last - erase_first + 1) * 512);
+        push(0X00);
+        start_busy(16);
+        break;
+    default:
+        push(0X04);
+        break;
+    }
+}
@@ -0,0 +1,117 @@
+/**
+ * @file SimCard.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief SD card in SPI mode simulated behind the fake AVR registers, for host tests.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIMCARD_H_
+#define _SIMCARD_H_
+
+#include <stdint.h>
+
+/**
+ * Answers the bytes SDCard clocks through SPDR like an SDHC card would.
+ * The card is selected while PORTB bit CS_PIN is low. Every 1000 bytes
+ * clocked count as one millisecond for the Millis timer interrupt, and
+ * every 64 as one tick of TIMER2 running at f_osc/1024.
+ */
+class SimCard {
+public:
+    SimCard();
+    void reset();
+    uint8_t exchange(uint8_t mosi);
+
+    static const uint32_t BLOCKS = 8192;
+    static const uint8_t CS_PIN = 1;
+    static const uint32_t NONE = 0XFFFFFFFF;
+    static const uint32_t FOREVER = 0XFFFFFFFF;
+
+    uint8_t data[BLOCKS * 512];
+
+    // faults to inject
+    uint32_t read_error_block;  // sends an error token instead of this block
+    uint32_t write_reject_block;    // rejects the data written to this block
+    bool stuck_busy;            // stays busy after the next write or stop token
+    bool status_error;          // CMD13 reports a general error
+    bool no_single_erase;       // CSD clears ERASE_BLK_EN after the next init
+    bool defer_irq;             // SPI interrupts wait for sim_spi_interrupts()
+
+    // observations
+    uint32_t commands[64];      // commands received by index, CMD55 included
+    uint8_t last_command;
+    uint32_t stop_tokens;       // stop tran tokens ending a CMD25
+    uint32_t protocol_errors;   // commands sent while a CMD18 or CMD25 was open
+    uint32_t busy;              // bytes the card still answers busy
+    uint32_t pre_erase;         // block count of the last ACMD23
+    uint32_t clocked;           // bytes clocked since reset
+    uint32_t timer_irqs;        // TIMER2 compare interrupts delivered
+    uint32_t timer_reads;       // TCNT2 reads
+    void (*on_erase)();         // called by CMD38 before it erases, to check what the card holds
+
+    bool in_read_multiple();
+    bool in_write_multiple();
+
+private:
+    enum class Phase {
+        COMMAND,        /** waiting for a command */
+        READ_STREAM,    /** sending CMD18 blocks until CMD12 */
+        WRITE_TOKEN,    /** waiting for a data or stop token after CMD24/CMD25 */
+        WRITE_DATA      /** receiving a data block and its crc */
+    };
+
+    Phase phase;
+    bool idle;
+    bool app;           // next command is an application command
+    uint8_t acmd41;
+    uint8_t frame[6];
+    uint8_t frame_len;
+    uint32_t block;     // next block to stream or to write
+    bool multiple;
+    bool stalled;       // stream stopped on an error token
+    uint8_t rx[514];
+    uint16_t rx_len;
+    uint32_t erase_first;   // CMD32 and CMD33 range for CMD38
+    uint32_t erase_last;
+    uint32_t erase_count;   // ACMD23 count for the next CMD25
+    uint32_t pre_erase_end; // blocks of a CMD25 up to here lose their data unless written
+
+    uint8_t out[2048];
+    uint16_t out_head;
+    uint16_t out_len;
+
+    void push(uint8_t value);
+    void push_packet(const uint8_t *src, uint16_t count);
+    uint8_t pop();
+    void receive(uint8_t mosi);
+    void command();
+    void start_busy(uint32_t bytes);
+};
+
+extern SimCard sim_card;
+
+/** Delivers up to count SPI interrupts held back by SimCard::defer_irq. */
+void sim_spi_interrupts(uint16_t count);
+
+#endif /* _SIMCARD_H_ */
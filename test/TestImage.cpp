@@ -0,0 +1,465 @@
+/**
+ * @file TestImage.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief FAT disk image files for host tests and benchmarks: format, populate, check.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <TestImage.h>
+#include <FatStructs.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static const uint32_t PART_START = 2048;
+
+static bool write_at(FILE *image, uint32_t block, const void *src, uint32_t size)
+{
+    return !fseeko(image, (off_t)block * 512, SEEK_SET) && fwrite(src, 1, size, image) == size;
+}
+
+static bool read_at(FILE *image, uint32_t block, void *dst, uint32_t size)
+{
+    return !fseeko(image, (off_t)block * 512, SEEK_SET) && fread(dst, 1, size, image) == size;
+}
+
+bool TestImage::format(const char *path, uint16_t mb, uint8_t fat_bits, uint8_t blocks_per_cluster)
+{
+    bool fat32 = fat_bits == 32;
+    uint32_t total = mb * 2048UL;
+    uint32_t part = total - PART_START;
+    uint16_t reserved = fat32 ? 32 : 1;
+    uint16_t root_entries = fat32 ? 0 : 512;
+    uint32_t root_blocks = (root_entries * 32UL + 511) / 512;
+
+    // grow the FAT until it covers every cluster that fits beside it
+    uint32_t fat_size = 1;
+    uint32_t clusters;
+    for (;;) {
+        clusters = (part - reserved - 2 * fat_size - root_blocks) / blocks_per_cluster;
+        uint32_t need = ((clusters + 2) * (fat32 ? 4 : 2) + 511) / 512;
+        if (need <= fat_size)
+            break;
+        fat_size = need;
+    }
+
+    FILE *image = fopen(path, "w+b");
+    if (!image)
+        return false;
+    bool ok = !ftruncate(fileno(image), (off_t)total * 512);
+
+    mbr_t mbr;
+    memset(&mbr, 0, sizeof(mbr));
+    mbr.part[0].type = fat32 ? 0X0C : 0X06;
+    mbr.part[0].firstSector = PART_START;
+    mbr.part[0].totalSectors = part;
+    mbr.mbrSig0 = BOOTSIG0;
+    mbr.mbrSig1 = BOOTSIG1;
+    ok = ok && write_at(image, 0, &mbr, sizeof(mbr));
+
+    fbs_t fbs;
+    memset(&fbs, 0, sizeof(fbs));
+    memcpy(fbs.jmpToBootCode, "\xEB\x58\x90", 3);
+    memcpy(fbs.oemName, "TESTIMG ", 8);
+    fbs.bpb.bytesPerSector = 512;
+    fbs.bpb.sectorsPerCluster = blocks_per_cluster;
+    fbs.bpb.reservedSectorCount = reserved;
+    fbs.bpb.fatCount = 2;
+    fbs.bpb.rootDirEntryCount = root_entries;
+    fbs.bpb.mediaType = 0XF8;
+    fbs.bpb.sectorsPerTrtack = 63;
+    fbs.bpb.headCount = 255;
+    fbs.bpb.hidddenSectors = PART_START;
+    fbs.bpb.totalSectors32 = part;
+    if (fat32) {
+        fbs.bpb.sectorsPerFat32 = fat_size;
+        fbs.bpb.fat32RootCluster = 2;
+        fbs.bpb.fat32FSInfo = 1;
+        fbs.bpb.fat32BackBootBlock = 6;
+    } else {
+        fbs.bpb.sectorsPerFat16 = fat_size;
+    }
+    fbs.driveNumber = 0X80;
+    fbs.bootSignature = 0X29;
+    fbs.volumeSerialNumber = 0X12345678;
+    memcpy(fbs.volumeLabel, "NO NAME    ", 11);
+    memcpy(fbs.fileSystemType, fat32 ? "FAT32   " : "FAT16   ", 8);
+    fbs.bootSectorSig0 = BOOTSIG0;
+    fbs.bootSectorSig1 = BOOTSIG1;
+    ok = ok && write_at(image, PART_START, &fbs, sizeof(fbs));
+
+    uint8_t fat[12];
+    if (fat32) {
+        // the root directory takes cluster 2
+        fsinfo_t fsinfo;
+        memset(&fsinfo, 0, sizeof(fsinfo));
+        fsinfo.leadSignature = FSINFO_LEAD_SIG;
+        fsinfo.structSignature = FSINFO_STRUCT_SIG;
+        fsinfo.freeCount = clusters - 1;
+        fsinfo.nextFree = 3;
+        fsinfo.tailSignature[2] = BOOTSIG0;
+        fsinfo.tailSignature[3] = BOOTSIG1;
+        ok = ok && write_at(image, PART_START + 1, &fsinfo, sizeof(fsinfo));
+        ok = ok && write_at(image, PART_START + 6, &fbs, sizeof(fbs));
+
+        uint32_t entries[3] = {0X0FFFFFF8, FAT32EOC, FAT32EOC};
+        memcpy(fat, entries, sizeof(entries));
+    } else {
+        uint16_t entries[2] = {0XFFF8, FAT16EOC};
+        memcpy(fat, entries, sizeof(entries));
+    }
+    for (uint8_t i = 0; i < 2; i++)
+        ok = ok && write_at(image, PART_START + reserved + i * fat_size, fat, fat32 ? 12 : 4);
+
+    return !fclose(image) && ok;
+}
+
+// sets a directory entry for name, an 8.3 name without the dot
+static void set_entry(dir_t *entry, const char *name, uint8_t attributes, uint32_t cluster)
+{
+    memset(entry, 0, sizeof(dir_t));
+    memset(entry->name, ' ', 11);
+    memcpy(entry->name, name, strnlen(name, 11));
+    entry->attributes = attributes;
+    entry->firstClusterHigh = cluster >> 16;
+    entry->firstClusterLow = cluster & 0XFFFF;
+}
+
+// adds an entry to the first block of the FAT32 root
+static bool add_root_entry(FILE *image, const fbs_t &fbs, uint32_t data_start, const char *name, uint32_t cluster)
+{
+    dir_t root[16];
+    uint32_t root_block = data_start + (fbs.bpb.fat32RootCluster - 2) * fbs.bpb.sectorsPerCluster;
+    if (!read_at(image, root_block, root, sizeof(root)))
+        return false;
+    uint8_t slot = 0;
+    while (slot < 16 && root[slot].name[0] != DIR_NAME_FREE)
+        slot++;
+    if (slot == 16)
+        return false;
+    set_entry(&root[slot], name, DIR_ATT_DIRECTORY, cluster);
+    return write_at(image, root_block, root, sizeof(root));
+}
+
+bool TestImage::add_dir(const char *path, const char *name, uint16_t entries)
+{
+    FILE *image = fopen(path, "r+b");
+    if (!image)
+        return false;
+
+    fbs_t fbs;
+    bool ok = read_at(image, PART_START, &fbs, sizeof(fbs)) && !fbs.bpb.sectorsPerFat16;
+    uint32_t fat_size = fbs.bpb.sectorsPerFat32;
+    uint32_t fat_start = PART_START + fbs.bpb.reservedSectorCount;
+    uint32_t data_start = fat_start + fbs.bpb.fatCount * fat_size;
+    uint16_t per_cluster = fbs.bpb.sectorsPerCluster * 512 / sizeof(dir_t);
+    uint16_t clusters = (entries + 2 + per_cluster - 1) / per_cluster;
+
+    std::vector<uint32_t> fat(fat_size * 128);
+    ok = ok && read_at(image, fat_start, fat.data(), fat_size * 512);
+
+    std::vector<dir_t> dir(clusters * per_cluster);
+    memset(dir.data(), 0, dir.size() * sizeof(dir_t));
+    memcpy(dir[0].name, ".          ", 11);
+    memcpy(dir[1].name, "..         ", 11);
+    dir[0].attributes = dir[1].attributes = DIR_ATT_DIRECTORY;
+    for (uint16_t i = 0; i < entries; i++) {
+        char entry_name[13];
+        snprintf(entry_name, sizeof(entry_name), "F%04u   TXT", i);
+        memcpy(dir[i + 2].name, entry_name, 11);
+        dir[i + 2].attributes = DIR_ATT_ARCHIVE;
+    }
+
+    for (uint16_t i = 0; ok && i < clusters; i++) {
+        uint32_t cluster = 1000 + i * 5;
+        fat[cluster] = i + 1 < clusters ? cluster + 5 : FAT32EOC;
+        ok = write_at(image, data_start + (cluster - 2) * fbs.bpb.sectorsPerCluster,
+                      &dir[i * per_cluster], per_cluster * sizeof(dir_t));
+    }
+    for (uint8_t i = 0; ok && i < fbs.bpb.fatCount; i++)
+        ok = write_at(image, fat_start + i * fat_size, fat.data(), fat_size * 512);
+
+    fsinfo_t fsinfo;
+    uint32_t fsinfo_block = PART_START + fbs.bpb.fat32FSInfo;
+    ok = ok && read_at(image, fsinfo_block, &fsinfo, sizeof(fsinfo));
+    if (ok && fsinfo.freeCount != FSINFO_UNKNOWN)
+        fsinfo.freeCount -= clusters;
+    ok = ok && write_at(image, fsinfo_block, &fsinfo, sizeof(fsinfo));
+
+    // entry in the first block of the root
+    dir_t root[16];
+    uint32_t root_block = data_start + (fbs.bpb.fat32RootCluster - 2) * fbs.bpb.sectorsPerCluster;
+    ok = ok && read_at(image, root_block, root, sizeof(root));
+    uint8_t slot = 0;
+    while (slot < 16 && root[slot].name[0] != DIR_NAME_FREE)
+        slot++;
+    ok = ok && slot < 16;
+    if (ok) {
+        memset(&root[slot], 0, sizeof(dir_t));
+        memset(root[slot].name, ' ', 11);
+        memcpy(root[slot].name, name, strnlen(name, 8));
+        root[slot].attributes = DIR_ATT_DIRECTORY;
+        root[slot].firstClusterHigh = 0;
+        root[slot].firstClusterLow = 1000;
+        ok = write_at(image, root_block, root, sizeof(root));
+    }
+
+    return !fclose(image) && ok;
+}
+
+bool TestImage::add_path(const char *path, const char *dirs)
+{
+    FILE *image = fopen(path, "r+b");
+    if (!image)
+        return false;
+
+    fbs_t fbs;
+    bool ok = read_at(image, PART_START, &fbs, sizeof(fbs)) && !fbs.bpb.sectorsPerFat16;
+    uint32_t fat_size = fbs.bpb.sectorsPerFat32;
+    uint32_t fat_start = PART_START + fbs.bpb.reservedSectorCount;
+    uint32_t data_start = fat_start + fbs.bpb.fatCount * fat_size;
+
+    std::vector<uint32_t> fat(fat_size * 128);
+    ok = ok && read_at(image, fat_start, fat.data(), fat_size * 512);
+
+    std::vector<std::string> names;
+    for (const char *p = dirs; *p; p++) {
+        if (p == dirs || p[-1] == '/')
+            names.push_back("");
+        if (*p != '/')
+            names.back() += *p;
+    }
+    ok = ok && !names.empty() && add_root_entry(image, fbs, data_start, names[0].c_str(), 2000);
+
+    // one cluster per directory from 2000 on, each holds the next
+    uint32_t cluster = 2000;
+    for (size_t i = 0; ok && i < names.size(); i++, cluster++) {
+        dir_t dir[16];
+        memset(dir, 0, sizeof(dir));
+        set_entry(&dir[0], ".", DIR_ATT_DIRECTORY, cluster);
+        set_entry(&dir[1], "..", DIR_ATT_DIRECTORY, i ? cluster - 1 : 0);
+        if (i + 1 < names.size())
+            set_entry(&dir[2], names[i + 1].c_str(), DIR_ATT_DIRECTORY, cluster + 1);
+        else
+            set_entry(&dir[2], "FILE    TXT", DIR_ATT_ARCHIVE, 0);
+        ok = write_at(image, data_start + (cluster - 2) * fbs.bpb.sectorsPerCluster, dir, sizeof(dir));
+        fat[cluster] = FAT32EOC;
+    }
+    for (uint8_t i = 0; ok && i < fbs.bpb.fatCount; i++)
+        ok = write_at(image, fat_start + i * fat_size, fat.data(), fat_size * 512);
+
+    fsinfo_t fsinfo;
+    uint32_t fsinfo_block = PART_START + fbs.bpb.fat32FSInfo;
+    ok = ok && read_at(image, fsinfo_block, &fsinfo, sizeof(fsinfo));
+    if (ok && fsinfo.freeCount != FSINFO_UNKNOWN)
+        fsinfo.freeCount -= cluster - 2000;
+    ok = ok && write_at(image, fsinfo_block, &fsinfo, sizeof(fsinfo));
+
+    return !fclose(image) && ok;
+}
+
+uint8_t* TestImage::load(const char *path, uint32_t *block_count)
+{
+    FILE *image = fopen(path, "rb");
+    if (!image)
+        return nullptr;
+
+    fseeko(image, 0, SEEK_END);
+    *block_count = ftello(image) / 512;
+    uint8_t *data = new uint8_t[*block_count * 512UL];
+    if (!read_at(image, 0, data, *block_count * 512UL)) {
+        delete[] data;
+        data = nullptr;
+    }
+    fclose(image);
+    return data;
+}
+
+namespace {
+
+/** State of one TestImage::check() run */
+struct Volume {
+    FILE *image;
+    const char *path;
+    bool fat32;
+    uint8_t blocks_per_cluster;
+    uint32_t data_start;
+    uint32_t clusters;
+    std::vector<uint8_t> fat;
+    std::vector<bool> used;
+    uint16_t errors;
+
+    uint32_t get(uint32_t cluster)
+    {
+        if (fat32)
+            return ((uint32_t*)fat.data())[cluster] & FAT32MASK;
+        return ((uint16_t*)fat.data())[cluster];
+    }
+
+    bool is_eoc(uint32_t cluster)
+    {
+        return cluster >= (fat32 ? FAT32EOC_MIN : FAT16EOC_MIN);
+    }
+
+    void error(const char *what, const char *name, uint32_t value)
+    {
+        printf("%s: %s%s %u\n", path, name, what, value);
+        errors++;
+    }
+
+    // marks the chain used and returns its clusters, stops at the first bad link
+    std::vector<uint32_t> chain(uint32_t cluster, const char *name)
+    {
+        std::vector<uint32_t> out;
+        while (cluster && !is_eoc(cluster)) {
+            if (cluster < 2 || cluster > clusters + 1) {
+                error(" bad cluster", name, cluster);
+                break;
+            }
+            if (used[cluster]) {
+                error(" crosslink at cluster", name, cluster);
+                break;
+            }
+            used[cluster] = true;
+            out.push_back(cluster);
+            cluster = get(cluster);
+        }
+        return out;
+    }
+
+    std::vector<dir_t> read_dir(const std::vector<uint32_t> &chain)
+    {
+        uint16_t per_cluster = blocks_per_cluster * 512 / sizeof(dir_t);
+        std::vector<dir_t> out(chain.size() * per_cluster);
+        for (size_t i = 0; i < chain.size(); i++) {
+            if (!read_at(image, data_start + (chain[i] - 2) * blocks_per_cluster,
+                         &out[i * per_cluster], per_cluster * sizeof(dir_t)))
+                error(" unreadable cluster", "", chain[i]);
+        }
+        return out;
+    }
+
+    void walk(const std::vector<dir_t> &dir, uint8_t depth)
+    {
+        for (size_t i = 0; i < dir.size(); i++) {
+            const dir_t *p = &dir[i];
+            if (p->name[0] == DIR_NAME_FREE)
+                break;
+            if (p->name[0] == DIR_NAME_DELETED || p->name[0] == '.' || !DIR_IS_FILE_OR_SUBDIR(p))
+                continue;
+
+            char name[12];
+            memcpy(name, p->name, 11);
+            name[11] = 0;
+            for (size_t k = 0; k < i; k++) {
+                if (dir[k].name[0] != DIR_NAME_DELETED && !memcmp(dir[k].name, p->name, 11))
+                    error(" duplicate name, entry", name, i);
+            }
+            uint32_t first = (uint32_t)p->firstClusterHigh << 16 | p->firstClusterLow;
+            std::vector<uint32_t> clusters = chain(first, name);
+            if (DIR_IS_SUBDIR(p)) {
+                if (depth < 16)
+                    walk(read_dir(clusters), depth + 1);
+            } else {
+                uint32_t cluster_size = blocks_per_cluster * 512UL;
+                uint32_t need = (p->fileSize + cluster_size - 1) / cluster_size;
+                if (clusters.size() != need)
+                    error(" chain length differs from size, clusters", name, clusters.size());
+            }
+        }
+    }
+};
+
+}
+
+uint16_t TestImage::check(const char *path)
+{
+    Volume v;
+    v.path = path;
+    v.errors = 0;
+    v.image = fopen(path, "rb");
+    if (!v.image) {
+        printf("%s: cannot open\n", path);
+        return 1;
+    }
+
+    mbr_t mbr;
+    fbs_t fbs;
+    if (!read_at(v.image, 0, &mbr, sizeof(mbr)) ||
+        !read_at(v.image, mbr.part[0].firstSector, &fbs, sizeof(fbs))) {
+        fclose(v.image);
+        printf("%s: no boot sector\n", path);
+        return 1;
+    }
+
+    uint32_t start = mbr.part[0].firstSector;
+    v.fat32 = !fbs.bpb.sectorsPerFat16;
+    v.blocks_per_cluster = fbs.bpb.sectorsPerCluster;
+    uint32_t fat_size = v.fat32 ? fbs.bpb.sectorsPerFat32 : fbs.bpb.sectorsPerFat16;
+    uint32_t fat_start = start + fbs.bpb.reservedSectorCount;
+    uint32_t root_blocks = (fbs.bpb.rootDirEntryCount * 32UL + 511) / 512;
+    v.data_start = fat_start + fbs.bpb.fatCount * fat_size + root_blocks;
+    uint32_t total = fbs.bpb.totalSectors16 ? fbs.bpb.totalSectors16 : fbs.bpb.totalSectors32;
+    v.clusters = (total - (v.data_start - start)) / v.blocks_per_cluster;
+
+    v.fat.resize(fat_size * 512);
+    read_at(v.image, fat_start, v.fat.data(), fat_size * 512);
+    std::vector<uint8_t> copy(fat_size * 512);
+    for (uint8_t i = 1; i < fbs.bpb.fatCount; i++) {
+        read_at(v.image, fat_start + i * fat_size, copy.data(), fat_size * 512);
+        if (copy != v.fat)
+            v.error("FAT copy differs from the first, copy", "", i);
+    }
+
+    v.used.assign(v.clusters + 2, false);
+    if (v.fat32) {
+        v.walk(v.read_dir(v.chain(fbs.bpb.fat32RootCluster, "root")), 0);
+    } else {
+        std::vector<dir_t> root(fbs.bpb.rootDirEntryCount);
+        read_at(v.image, fat_start + fbs.bpb.fatCount * fat_size, root.data(), root_blocks * 512);
+        v.walk(root, 0);
+    }
+
+    uint32_t free = 0;
+    for (uint32_t c = 2; c < v.clusters + 2; c++) {
+        if (!v.get(c))
+            free++;
+        else if (!v.used[c]) {
+            v.error("lost cluster", "", c);
+            break;
+        }
+    }
+
+    if (v.fat32) {
+        fsinfo_t fsinfo;
+        read_at(v.image, start + fbs.bpb.fat32FSInfo, &fsinfo, sizeof(fsinfo));
+        if (fsinfo.freeCount != FSINFO_UNKNOWN && fsinfo.freeCount != free)
+            v.error("FSInfo free count differs, actual", "", free);
+    }
+
+    fclose(v.image);
+    return v.errors;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file TestImage.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief FAT disk image files for host tests and benchmarks: format, populate, check.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TESTIMAGE_H_
+#define _TESTIMAGE_H_
+
+#include <stdint.h>
+
+/**
+ * Works on disk image files through stdio, independently of the FAT and
+ * File classes under test. Images hold one MBR partition at block 2048
+ * with two FATs.
+ */
+class TestImage {
+public:
+    /**
+     * @brief Writes an empty FAT16 or FAT32 image file of the given size.
+     * 
+     * @details FAT32 images get a valid FSInfo sector with the free count.
+     */
+    static bool format(const char *path, uint16_t mb, uint8_t fat_bits, uint8_t blocks_per_cluster);
+
+    /**
+     * @brief Adds a directory to the root of a freshly formatted FAT32 image.
+     * 
+     * @details The directory holds the empty files F0000.TXT, F0001.TXT and
+     * so on. Its chain starts at cluster 1000 and takes every fifth cluster,
+     * so it spreads over several FAT sectors.
+     */
+    static bool add_dir(const char *path, const char *name, uint16_t entries);
+
+    /**
+     * @brief Adds nested directories to the root of a freshly formatted FAT32 image.
+     * 
+     * @details dirs names them from the root down, as in "A/B/C", each
+     * name 8 characters at most. They take one cluster each from cluster
+     * 2000 on, and the last one holds the empty file FILE.TXT.
+     */
+    static bool add_path(const char *path, const char *dirs);
+
+    /**
+     * @brief Reads a whole image into memory, for a RamDisk.
+     * 
+     * @return The image data from new[], or nullptr if it cannot be read.
+     */
+    static uint8_t* load(const char *path, uint32_t *block_count);
+
+    /**
+     * @brief Checks the volume like a disk check would.
+     * 
+     * @details Compares the FAT copies, walks every directory and checks
+     * each chain against its file size, and looks for duplicate names,
+     * cross-linked and lost clusters and a wrong FSInfo free count. Prints
+     * each problem found.
+     * 
+     * @return The number of problems, 0 for a consistent volume.
+     */
+    static uint16_t check(const char *path);
+
+};
+
+#endif /* _TESTIMAGE_H_ */
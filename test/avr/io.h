@@ -0,0 +1,93 @@
+/**
+ * @file io.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host stand-in for the AVR registers used by SPI, SDCard and Millis.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIM_AVR_IO_H_
+#define _SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+#define __AVR_ATmega328P__ 1
+
+/** SPI data register, each write clocks one byte through the simulated card. */
+class SimSPDR {
+public:
+    SimSPDR& operator=(uint8_t data);
+    operator uint8_t() const;
+};
+
+/** SPI control register, setting SPIE delivers the transfer interrupts. */
+class SimSPCR {
+public:
+    SimSPCR& operator=(int value);
+    SimSPCR& operator|=(int bits);
+    SimSPCR& operator&=(int bits);
+    operator uint8_t() const;
+};
+
+/** Timer 2 counter, it runs at f_osc/1024 when started with that prescaler. */
+class SimTCNT2 {
+public:
+    SimTCNT2& operator=(uint8_t value);
+    operator uint8_t() const;
+};
+
+extern SimSPDR SPDR;
+extern SimSPCR SPCR;
+extern SimTCNT2 TCNT2;
+extern volatile uint8_t SPSR;   // SPIF is always set, transfers complete at once
+extern volatile uint8_t DDRB, PORTB;
+extern volatile uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2;
+
+#define SPE 6
+#define MSTR 4
+#define SPR1 1
+#define SPR0 0
+#define SPI2X 0
+#define SPIF 7
+#define SPIE 7
+
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+
+#define WGM21 1
+#define CS22 2
+#define CS21 1
+#define CS20 0
+#define OCIE2A 1
+
+#ifdef SIM_SPI_POLLS
+/** Iterations of every busy wait, counted for the SPI benchmark. */
+extern uint32_t sim_spi_polls;
+#define loop_until_bit_is_set(r, b) do { sim_spi_polls++; } while (!((r) & (1 << (b))))
+#else
+#define loop_until_bit_is_set(r, b) do {} while (!((r) & (1 << (b))))
+#endif
+
+#endif /* _SIM_AVR_IO_H_ */
@@ -0,0 +1,81 @@
+/**
+ * @file AppendBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: appending a log in small records with periodic syncs.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * usage: AppendBench image mb fat_bits blocks_per_cluster [sync_every [deferred]]
+ * 
+ * Formats the image, then writes 1 MiB to a new file as 100 byte records,
+ * syncing every sync_every records (default 40, 0 for only at close). A
+ * third argument of 1 defers the FAT mirror updates. Prints the device
+ * block counts.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 5 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])))
+        return 1;
+
+    ImageDisk disk(argv[1]);
+    disk.init();
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+    uint16_t sync_every = argc > 5 ? atoi(argv[5]) : 40;
+    if (argc > 6)
+        fs.set_deferred_mirror(atoi(argv[6]));
+
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    if (!f.open(root, "LOG.TXT", File::O_CREAT | File::O_WRITE | File::O_TRUNC))
+        return 1;
+    disk.clear_counters();
+
+    uint8_t record[100];
+    for (uint8_t i = 0; i < sizeof(record); i++)
+        record[i] = 'a' + i % 26;
+    for (uint16_t i = 0; i < 10486; i++) {
+        if (f.write(record, sizeof(record)) != sizeof(record))
+            return 1;
+        if (sync_every && i % sync_every == sync_every - 1)
+            f.sync();
+    }
+    f.close();
+    fs.unmount();
+
+#ifdef FAT_CACHE_STATS
+    printf("slots %d  hits %6u  misses %5u  ", FAT_CACHE_SLOTS, fs.get_cache_hits(), fs.get_cache_misses());
+#endif
+    printf("reads %5u  writes %5u\n", disk.get_read_count(), disk.get_write_count());
+    disk.close();
+    return TestImage::check(argv[1]) != 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file AuBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: sustained writes with and without AU aligned files.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// latency model, a block programmed in order and a block copied by an AU merge
+static const uint32_t WRITE_US = 250;
+static const uint32_t COPY_US = 500;
+
+/**
+ * usage: AuBench image mb fat_bits blocks_per_cluster au_blocks align
+ * 
+ * Formats the image, writes 40 files of 100 KB and removes every other
+ * one, leaving holes inside AUs. Then writes 8 files of 1 MB each in 4 KB
+ * writes, syncing every 64 writes, with O_ALIGN and set_alloc_unit() if
+ * the last argument is 1. The disk counts the AU merges of a card with
+ * AUs of au_blocks during these writes.
+ * Prints the block writes, the merges and the blocks they copy, and the
+ * time of the writes under the latency model above.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 7 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])))
+        return 1;
+    uint32_t au_blocks = atoi(argv[5]);
+    bool align = atoi(argv[6]);
+
+    ImageDisk disk(argv[1]);
+    disk.init();
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+    if (align && !fs.set_alloc_unit(au_blocks))
+        return 1;
+    File root(&fs);
+    root.open_root();
+
+    static uint8_t buffer[4096];
+    for (uint16_t i = 0; i < sizeof(buffer); i++)
+        buffer[i] = i * 7;
+    File f(&fs);
+    char name[13];
+    for (uint8_t n = 0; n < 40; n++) {
+        snprintf(name, sizeof(name), "OLD%u.BIN", n);
+        if (!f.open(root, name, File::O_CREAT | File::O_WRITE))
+            return 1;
+        for (uint8_t i = 0; i < 25; i++) {
+            if (f.write(buffer, 4096) != 4096)
+                return 1;
+        }
+        if (!f.close())
+            return 1;
+    }
+    for (uint8_t n = 0; n < 40; n += 2) {
+        snprintf(name, sizeof(name), "OLD%u.BIN", n);
+        if (!f.open(root, name, File::O_WRITE) || !f.rm())
+            return 1;
+    }
+    if (!fs.sync())
+        return 1;
+
+    disk.set_au_model(au_blocks);
+    disk.clear_counters();
+    uint8_t oflag = File::O_CREAT | File::O_WRITE | (align ? File::O_ALIGN : 0);
+    for (uint8_t n = 0; n < 8; n++) {
+        snprintf(name, sizeof(name), "LOG%u.BIN", n);
+        if (!f.open(root, name, oflag))
+            return 1;
+        for (uint16_t i = 0; i < 256; i++) {
+            if (f.write(buffer, 4096) != 4096)
+                return 1;
+            if (i % 64 == 63 && !f.sync())
+                return 1;
+        }
+        if (!f.close())
+            return 1;
+    }
+    disk.close_aus();
+
+    uint32_t us = disk.get_write_count() * WRITE_US + disk.get_au_copies() * COPY_US;
+    printf("align %d  writes %5u  merges %3u  copied %6u  time %5u ms  %4u KB/s\n", align,
+           disk.get_write_count(), disk.get_au_merges(), disk.get_au_copies(), us / 1000,
+           (uint32_t)(8 * 1024 * 1000000ULL / us));
+
+    fs.unmount();
+    disk.close();
+    return TestImage::check(argv[1]) != 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file FragBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: allocation and chain walks in a fragmented FAT.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now_ms()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+/**
+ * usage: FragBench image mb fat_bits blocks_per_cluster
+ * 
+ * Formats the image and runs on a RamDisk copy of it. Two chains of 20000
+ * clusters are allocated one cluster at a time, interleaved, and one of
+ * them is freed, so every other cluster in the region is free. Prints the
+ * best of 7 runs of the chain walk and of the allocations across the
+ * region.
+ */
+int main(int argc, char **argv)
+{
+    uint32_t block_count;
+    uint8_t *data;
+    if (argc < 5 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])) ||
+        !(data = TestImage::load(argv[1], &block_count)))
+        return 1;
+
+    RamDisk disk(data, block_count);
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t head_a = 0;
+    uint32_t head_b = 0;
+    for (uint16_t i = 0; i < 20000; i++) {
+        if (!fs.alloc_contiguous(1, &a) || !fs.alloc_contiguous(1, &b))
+            return 1;
+        if (!head_a) head_a = a;
+        if (!head_b) head_b = b;
+    }
+    if (!fs.free_chain(head_b))
+        return 1;
+
+    double best_chain = 1e9;
+    double best_run = 1e9;
+    double best_free = 1e9;
+    uint32_t size = 0;
+    for (uint8_t r = 0; r < 7; r++) {
+        double t = now_ms();
+        for (uint8_t i = 0; i < 200; i++) {
+            if (!fs.get_chain_size(head_a, &size))
+                return 1;
+        }
+        t = now_ms() - t;
+        if (t < best_chain) best_chain = t;
+
+        t = now_ms();
+        for (uint8_t i = 0; i < 200; i++) {
+            uint32_t c = 0;
+            if (!fs.alloc_contiguous(2, &c) || !fs.free_chain(c))
+                return 1;
+        }
+        t = now_ms() - t;
+        if (t < best_run) best_run = t;
+
+        t = now_ms();
+        for (uint8_t i = 0; i < 20; i++) {
+            uint32_t c = 0;
+            uint32_t head = 0;
+            for (uint16_t j = 0; j < 1000; j++) {
+                if (!fs.alloc_contiguous(1, &c))
+                    return 1;
+                if (!head) head = c;
+            }
+            if (!fs.free_chain(head))
+                return 1;
+        }
+        t = now_ms() - t;
+        if (t < best_free) best_free = t;
+    }
+    fs.unmount();
+
+    printf("get_chain_size of the remaining chain x200  %6.1f ms (%u bytes)\n", best_chain, size);
+    printf("alloc_contiguous(2) across the region x200  %6.1f ms\n", best_run);
+    printf("1000 single cluster allocations + free x20  %6.1f ms\n", best_free);
+    delete[] data;
+    return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file FullBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: allocating on a nearly full and on a full volume.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint8_t buffer[4096];
+
+static bool create(FAT &fs, File &root, const char *name, uint16_t size)
+{
+    File f(&fs);
+    return f.open(root, name, File::O_CREAT | File::O_WRITE) && f.write(buffer, size) == size && f.close();
+}
+
+/**
+ * usage: FullBench image mb fat_bits blocks_per_cluster fill_kb
+ * 
+ * Formats the image and fills it up, leaving 20 one cluster holes after
+ * the first fill_kb KiB. After a remount, it removes one small file at a
+ * time and creates a new one in the hole. Then it tries to create files
+ * on the full volume. Prints the device block reads of both steps.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 6 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])))
+        return 1;
+    uint32_t fill = atol(argv[5]) * 1024;
+    uint16_t cluster_size = atoi(argv[4]) * 512;
+
+    ImageDisk disk(argv[1]);
+    disk.init();
+    char name[13];
+    {
+        FAT fs(&disk);
+        if (!fs.mount())
+            return 1;
+        File root(&fs);
+        root.open_root();
+        File f(&fs);
+        if (!f.open(root, "FILL1.BIN", File::O_CREAT | File::O_WRITE))
+            return 1;
+        for (uint32_t n = 0; n < fill && f.write(buffer, cluster_size) == cluster_size; n += cluster_size);
+        f.close();
+
+        // small files to remove and pads to keep the holes apart
+        for (uint8_t i = 0; i < 20; i++) {
+            sprintf(name, "S%02u.BIN", i);
+            if (!create(fs, root, name, 512))
+                return 1;
+            sprintf(name, "P%02u.BIN", i);
+            if (!create(fs, root, name, 512))
+                return 1;
+        }
+        if (!f.open(root, "FILL2.BIN", File::O_CREAT | File::O_WRITE))
+            return 1;
+        while (f.write(buffer, cluster_size) == cluster_size);
+        f.close();
+        fs.unmount();
+    }
+
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+    File root(&fs);
+    root.open_root();
+    uint32_t total = 0;
+    uint32_t worst = 0;
+    for (uint8_t i = 0; i < 20; i++) {
+        File f(&fs);
+        sprintf(name, "S%02u.BIN", i);
+        if (!f.open(root, name, File::O_WRITE) || !f.rm())
+            return 1;
+        disk.clear_counters();
+        sprintf(name, "N%02u.BIN", i);
+        if (!create(fs, root, name, 512))
+            return 1;
+        uint32_t reads = disk.get_read_count();
+        total += reads;
+        if (reads > worst)
+            worst = reads;
+    }
+    printf("20 x (remove, create): reads %u, worst %u\n", total, worst);
+
+    disk.clear_counters();
+    for (uint8_t i = 0; i < 5; i++) {
+        File f(&fs);
+        f.open(root, "FULL.BIN", File::O_CREAT | File::O_WRITE);
+        if (f.write(buffer, 512) != 0)
+            return 1;
+        f.close();
+    }
+    printf("5 failed allocations on the full volume: reads %u\n", disk.get_read_count());
+
+    fs.unmount();
+    disk.close();
+    return TestImage::check(argv[1]) != 0;
+}
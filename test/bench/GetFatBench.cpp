@@ -0,0 +1,77 @@
+/**
+ * @file GetFatBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: FAT entry reads from cached sectors.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * usage: GetFatBench image mb fat_bits blocks_per_cluster
+ * 
+ * Formats the image and runs on a RamDisk copy of it. Reads the entries
+ * of clusters 2 to 10001 50 times and prints the best of 7 runs in
+ * nanoseconds per get_fat().
+ */
+int main(int argc, char **argv)
+{
+    uint32_t block_count;
+    uint8_t *data;
+    if (argc < 5 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])) ||
+        !(data = TestImage::load(argv[1], &block_count)))
+        return 1;
+
+    RamDisk disk(data, block_count);
+    FAT fs(&disk);
+    if (!fs.mount()) {
+        printf("FAT%s  mount rejected\n", argv[3]);
+        return 0;
+    }
+
+    uint32_t sum = 0;
+    double best = 1e9;
+    for (uint8_t r = 0; r < 7; r++) {
+        timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint8_t k = 0; k < 50; k++) {
+            for (uint32_t c = 2; c < 10002; c++) {
+                uint32_t value;
+                fs.get_fat(c, &value);
+                sum += value;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 500000;
+        if (ns < best)
+            best = ns;
+    }
+    printf("FAT%s  %.2f ns/get_fat (sum %u)\n", argv[3], best, sum);
+    delete[] data;
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file IndexBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: opens and creates in a large directory with and without a name index.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * usage: IndexBench image mb fat_bits blocks_per_cluster index_entries
+ * 
+ * Formats the image and adds the directory BIG with 2000 files. Opens 200
+ * random files in it, then creates 100 files and removes 34, with a name
+ * index of the given size (0 for none). Prints the device block reads of
+ * both steps.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 6 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])) ||
+        !TestImage::add_dir(argv[1], "BIG", 2000))
+        return 1;
+    uint16_t capacity = atoi(argv[5]);
+
+    ImageDisk disk(argv[1]);
+    disk.init();
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+    File root(&fs);
+    root.open_root();
+    File dir(&fs);
+    if (!dir.open(root, "BIG", File::O_READ))
+        return 1;
+    dir_index_entry_t *entries = new dir_index_entry_t[capacity];
+    DirIndex index(entries, capacity);
+    if (capacity)
+        dir.set_index(&index);
+
+    disk.clear_counters();
+    char name[13];
+    srand(1);
+    for (uint8_t i = 0; i < 200; i++) {
+        sprintf(name, "F%04u.TXT", rand() % 2000);
+        File f(&fs);
+        if (!f.open(dir, name, File::O_READ))
+            return 1;
+    }
+    uint32_t open_reads = disk.get_read_count();
+
+    disk.clear_counters();
+    for (uint8_t i = 0; i < 100; i++) {
+        File f(&fs);
+        sprintf(name, "N%04u.TXT", i);
+        if (!f.open(dir, name, File::O_CREAT | File::O_WRITE | File::O_EXCL) || !f.close())
+            return 1;
+        if (i % 3 == 0) {
+            sprintf(name, "F%04u.TXT", i * 7);
+            if (!f.open(dir, name, File::O_WRITE) || !f.rm())
+                return 1;
+        }
+    }
+    printf("index %4u  200 opens: reads %5u  100 creates + 34 rm: reads %5u\n",
+           capacity, open_reads, disk.get_read_count());
+
+    fs.unmount();
+    disk.close();
+    delete[] entries;
+    return TestImage::check(argv[1]) != 0;
+}
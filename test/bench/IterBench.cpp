@@ -0,0 +1,96 @@
+/**
+ * @file IterBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: listing a large directory by index and with DirIterator.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <DirIterator.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * usage: IterBench image mb fat_bits blocks_per_cluster
+ * 
+ * Formats the image and adds the directory BIG with 2000 files. Lists the
+ * first 255 entries with ls(buffer, options, index), then the whole
+ * directory in pages of 20 with a DirIterator resumed from a cookie, with
+ * an unrelated open between pages. Prints the device block reads of both.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 5 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])) ||
+        !TestImage::add_dir(argv[1], "BIG", 2000))
+        return 1;
+
+    ImageDisk disk(argv[1]);
+    disk.init();
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+    File root(&fs);
+    root.open_root();
+    File dir(&fs);
+    if (!dir.open(root, "BIG", File::O_READ))
+        return 1;
+
+    char name[16];
+    disk.clear_counters();
+    uint16_t found = 0;
+    for (uint8_t i = 0; i < 255; i++) {
+        if (dir.ls(name, File::LS_FILE, i))
+            found++;
+    }
+    printf("ls(index) for entries 0..254: %3u found, reads %4u\n", found, disk.get_read_count());
+
+    disk.clear_counters();
+    uint32_t cookie = 0;
+    uint16_t pages = 0;
+    found = 0;
+    for (;;) {
+        DirIterator it(dir, File::LS_FILE);
+        if (!it.seek(cookie))
+            return 1;
+        uint8_t k = 0;
+        dir_t *p;
+        while (k < 20 && (p = it.next())) {
+            it.get_name(p, name);
+            k++;
+        }
+        found += k;
+        pages++;
+        cookie = it.get_cookie();
+
+        File f(&fs);
+        if (!f.open(dir, "F0001.TXT", File::O_READ))
+            return 1;
+        if (k < 20)
+            break;
+    }
+    printf("iterator, %u pages of 20: %4u found, reads %4u\n", pages, found, disk.get_read_count());
+
+    disk.close();
+    return found != 2000;
+}
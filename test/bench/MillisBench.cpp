@@ -0,0 +1,82 @@
+/**
+ * @file MillisBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: clock reads and timer interrupts of SD card busy waits.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <SDCard.h>
+#include <SimCard.h>
+#include <stdio.h>
+
+static SDCard card(&PORTB, &DDRB, SimCard::CS_PIN);
+
+static uint32_t clocked;
+static uint32_t clock_reads;
+static uint32_t timer_irqs;
+
+static void start()
+{
+    clocked = sim_card.clocked;
+    clock_reads = sim_card.timer_reads + sim_atomic_blocks;
+    timer_irqs = sim_card.timer_irqs;
+}
+
+static void report(const char *name)
+{
+    // one byte clocked is 1 us, a wait_busy() spin clocks one byte
+    uint32_t us = sim_card.clocked - clocked;
+    uint32_t reads = sim_card.timer_reads + sim_atomic_blocks - clock_reads;
+    uint32_t irqs = sim_card.timer_irqs - timer_irqs;
+    printf("%-14s %4u ms  bytes %6u  clock reads %5u  bytes per read %4.1f  TIMER2 interrupts %3u (%4.0f/s)\n",
+           name, us / 1000, us, reads, (double)us / reads, irqs, irqs * 1E6 / us);
+}
+
+/**
+ * usage: MillisBench
+ * 
+ * Runs a read behind a card busy for 5 ms, and a write the card never
+ * finishes so wait_busy() runs to the write timeout. Prints the bytes
+ * clocked, Millis::get() clock reads and TIMER2 interrupts of each.
+ * Build with -DMILLIS_TICKLESS for the tick-less clock.
+ */
+int main()
+{
+    static uint8_t block[512];
+    if (!card.init())
+        return 1;
+
+    start();
+    sim_card.busy = 5000;
+    if (!card.read_block(0, block))
+        return 1;
+    report("busy 5 ms");
+
+    start();
+    sim_card.stuck_busy = true;
+    if (card.write_block(1, block))
+        return 1;
+    report("write timeout");
+    return 0;
+}
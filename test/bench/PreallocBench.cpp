@@ -0,0 +1,82 @@
+/**
+ * @file PreallocBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: appending to a file with and without preallocation.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * usage: PreallocBench image mb fat_bits blocks_per_cluster preallocate
+ * 
+ * Formats the image and creates a 10 KB file. The file is then reopened
+ * and 1 MB is appended in 4 KB writes, after preallocate() if the last
+ * argument is 1. Prints the device block writes and commands of the
+ * append.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 6 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])))
+        return 1;
+    bool preallocate = atoi(argv[5]);
+
+    ImageDisk disk(argv[1]);
+    disk.init();
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+    File root(&fs);
+    root.open_root();
+
+    static uint8_t buffer[4096];
+    for (uint16_t i = 0; i < sizeof(buffer); i++)
+        buffer[i] = i * 7;
+    File f(&fs);
+    if (!f.open(root, "LOG.BIN", File::O_CREAT | File::O_WRITE) ||
+        f.write(buffer, 4096) != 4096 || f.write(buffer, 4096) != 4096 ||
+        f.write(buffer, 2048) != 2048 || !f.close())
+        return 1;
+
+    if (!f.open(root, "LOG.BIN", File::O_WRITE | File::O_APPEND))
+        return 1;
+    if (preallocate && !f.preallocate(10240 + 1048576))
+        return 1;
+    disk.clear_counters();
+    for (uint16_t i = 0; i < 256; i++) {
+        if (f.write(buffer, 4096) != 4096)
+            return 1;
+    }
+    printf("preallocate %d  writes %4u  commands %3u  contiguous %d\n", preallocate,
+           disk.get_write_count(), disk.get_command_count(), f.is_contiguous());
+    if (!f.close())
+        return 1;
+
+    fs.unmount();
+    disk.close();
+    return TestImage::check(argv[1]) != 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file SeekBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: random record reads from a fragmented file.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * usage: SeekBench image mb fat_bits blocks_per_cluster
+ * 
+ * Formats the image and writes a 4 MB file in 8 fragments, with a small
+ * file growing between them. Then reads 5000 records of 100 bytes from
+ * random positions and prints the device block reads.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 5 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])))
+        return 1;
+
+    ImageDisk disk(argv[1]);
+    disk.init();
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+    File root(&fs);
+    root.open_root();
+
+    // each word holds its own index in the file
+    File a(&fs);
+    File b(&fs);
+    if (!a.open(root, "A.BIN", File::O_CREAT | File::O_WRITE) ||
+        !b.open(root, "B.BIN", File::O_CREAT | File::O_WRITE))
+        return 1;
+    uint32_t block[128];
+    for (uint32_t i = 0; i < 8192; i++) {
+        for (uint8_t k = 0; k < 128; k++)
+            block[k] = i * 128 + k;
+        if (a.write((uint8_t*)block, 512) != 512)
+            return 1;
+        if (i % 1024 == 1023 && b.write((uint8_t*)block, 4096) != 4096)
+            return 1;
+    }
+    a.close();
+    b.close();
+
+    if (!a.open(root, "A.BIN", File::O_READ))
+        return 1;
+    disk.clear_counters();
+    srand(1);
+    uint32_t bad = 0;
+    for (uint16_t i = 0; i < 5000; i++) {
+        uint32_t word = rand() % (8192 * 128 - 25);
+        uint32_t record[25];
+        if (!a.seek_set(word * 4) || a.read((uint8_t*)record, 100) != 100)
+            return 1;
+        for (uint8_t k = 0; k < 25; k++) {
+            if (record[k] != word + k)
+                bad++;
+        }
+    }
+    printf("extent slots %d  block reads %6u\n", FILE_EXTENT_SLOTS, disk.get_read_count());
+
+    a.close();
+    fs.unmount();
+    disk.close();
+    return bad || TestImage::check(argv[1]);
+}
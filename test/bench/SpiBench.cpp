@@ -0,0 +1,159 @@
+/**
+ * @file SpiBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: SPI register traffic of a 512 byte block.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <SPI.h>
+#include <stdio.h>
+#include <string.h>
+
+// fake registers, SPDR answers a byte count and SPIF is always set
+SimSPDR SPDR;
+SimSPCR SPCR;
+volatile uint8_t SPSR = 1 << SPIF;
+volatile uint8_t DDRB, PORTB;
+uint32_t sim_spi_polls;
+
+static uint8_t spcr_value;
+static uint8_t spdr_value;
+
+static uint8_t tx[512];
+static uint8_t rx[512];
+static uint16_t writes;
+static uint16_t reads;
+static uint16_t overlapped;     // transfers started before the previous byte was stored
+
+SimSPDR& SimSPDR::operator=(uint8_t data)
+{
+    // a receive stores every byte read, one not stored yet is still in a register
+    if (reads && writes == reads && rx[reads - 1] == 0XFF)
+        overlapped++;
+    if (writes < sizeof(tx))
+        tx[writes] = data;
+    spdr_value = writes++ & 0X7F;
+    return *this;
+}
+
+SimSPDR::operator uint8_t() const
+{
+    reads++;
+    return spdr_value;
+}
+
+SimSPCR& SimSPCR::operator=(int value)
+{
+    spcr_value = value;
+    return *this;
+}
+
+SimSPCR& SimSPCR::operator|=(int bits)
+{
+    spcr_value |= bits;
+    return *this;
+}
+
+SimSPCR& SimSPCR::operator&=(int bits)
+{
+    spcr_value &= bits;
+    return *this;
+}
+
+SimSPCR::operator uint8_t() const
+{
+    return spcr_value;
+}
+
+// the per byte loops SDCard ran before the block kernels
+static void loop_send(const uint8_t *src)
+{
+    for (uint16_t i = 0; i < 512; i++)
+        SPI::write(src[i]);
+}
+
+static void loop_receive(uint8_t *dst)
+{
+    for (uint16_t i = 0; i < 512; i++)
+        dst[i] = SPI::read();
+}
+
+static void kernel_send(const uint8_t *src)
+{
+    SPI::send_block(src, 512);
+}
+
+static void kernel_receive(uint8_t *dst)
+{
+    SPI::receive_block(dst, 512);
+}
+
+static void clear()
+{
+    writes = reads = overlapped = 0;
+    sim_spi_polls = 0;
+    memset(tx, 0, sizeof(tx));
+    memset(rx, 0XFF, sizeof(rx));
+}
+
+static bool send(const char *name, void (*fn)(const uint8_t *))
+{
+    static uint8_t src[512];
+    for (uint16_t i = 0; i < 512; i++)
+        src[i] = i * 7;
+    clear();
+    fn(src);
+    printf("send     %-6s  SPDR writes %3u  reads %3u  polls %3u\n", name, writes, reads, sim_spi_polls);
+    return writes == 512 && !memcmp(tx, src, 512);
+}
+
+static bool receive(const char *name, void (*fn)(uint8_t *))
+{
+    clear();
+    fn(rx);
+    printf("receive  %-6s  SPDR writes %3u  reads %3u  polls %3u  stores overlapped %3u\n",
+           name, writes, reads, sim_spi_polls, overlapped);
+    for (uint16_t i = 0; i < 512; i++)
+        if (rx[i] != (i & 0X7F) || tx[i] != 0XFF)
+            return false;
+    return writes == 512;
+}
+
+/**
+ * usage: SpiBench
+ * 
+ * Moves one 512 byte block each way through the fake SPI registers with
+ * the per byte SPI::write/SPI::read loops and with send_block() and
+ * receive_block(). Prints the SPDR accesses, the SPIF polls and, for a
+ * receive, the transfers started before the previous byte was stored.
+ * Fails if a variant moves different data.
+ */
+int main()
+{
+    bool ok = send("loop", loop_send);
+    ok = send("kernel", kernel_send) && ok;
+    ok = receive("loop", loop_receive) && ok;
+    ok = receive("kernel", kernel_receive) && ok;
+    return !ok;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file ViewBench.cpp
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host benchmark: parsing a log through read() against read_view().
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <File.h>
+#include <TestImage.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct parser_t {
+    uint32_t lines;
+    uint32_t sum;
+    uint32_t value;
+};
+
+// counts lines and sums the number that ends each one
+static void parse(parser_t *parser, const uint8_t *data, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++) {
+        uint8_t c = data[i];
+        if (c == '\n') {
+            parser->lines++;
+            parser->sum += parser->value;
+            parser->value = 0;
+        } else if (c >= '0' && c <= '9') {
+            parser->value = parser->value * 10 + (c - '0');
+        }
+    }
+}
+
+static double now_ms()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec * 1e-6;
+}
+
+/**
+ * usage: ViewBench image mb fat_bits blocks_per_cluster
+ * 
+ * Formats the image and writes a log of 400000 lines. Parses it with
+ * read() into buffers of 32, 64 and 512 bytes, and with read_view() and
+ * consume(). Prints the best of 3 runs and the device block reads.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 5 || !TestImage::format(argv[1], atoi(argv[2]), atoi(argv[3]), atoi(argv[4])))
+        return 1;
+
+    ImageDisk disk(argv[1]);
+    disk.init();
+    FAT fs(&disk);
+    if (!fs.mount())
+        return 1;
+    File root(&fs);
+    root.open_root();
+    File f(&fs);
+    if (!f.open(root, "LOG.TXT", File::O_CREAT | File::O_WRITE))
+        return 1;
+    for (uint32_t i = 0; i < 400000; i++) {
+        char line[32];
+        int n = sprintf(line, "t=%lu v=%lu\n", (unsigned long)i, (unsigned long)(i * 7 % 1000));
+        if (f.write((uint8_t*)line, n) != (size_t)n)
+            return 1;
+    }
+    printf("log of %u bytes\n", f.get_file_size());
+    f.close();
+
+    static uint8_t buffer[512];
+    const uint16_t sizes[] = {32, 64, 512, 0};
+    for (uint8_t k = 0; k < 4; k++) {
+        double best = 1e9;
+        parser_t parser;
+        for (uint8_t r = 0; r < 3; r++) {
+            if (!f.open(root, "LOG.TXT", File::O_READ))
+                return 1;
+            parser = {0, 0, 0};
+            disk.clear_counters();
+            double t = now_ms();
+            int16_t n;
+            if (sizes[k]) {
+                while ((n = f.read(buffer, sizes[k])) > 0)
+                    parse(&parser, buffer, n);
+            } else {
+                const uint8_t *data;
+                while ((n = f.read_view(&data)) > 0) {
+                    parse(&parser, data, n);
+                    f.consume(n);
+                }
+            }
+            t = now_ms() - t;
+            if (n < 0)
+                return 1;
+            if (t < best)
+                best = t;
+            f.close();
+        }
+        if (sizes[k])
+            printf("read(buffer, %3u)", sizes[k]);
+        else
+            printf("read_view()      ");
+        printf("  %5.1f ms  reads %5u  lines %u sum %u\n", best, disk.get_read_count(), parser.lines, parser.sum);
+    }
+
+    fs.unmount();
+    disk.close();
+    return 0;
+}
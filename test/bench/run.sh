@@ -0,0 +1,143 @@
+#!/bin/sh
+# Builds and runs the host benchmarks. "make bench" passes the compiler
+# command in CXX, the library and image sources in SOURCES and the output
+# directory in OUT. Each variant compiles the library with its own defines.
+# usage: run.sh [benchmark...]
+set -e
+
+# build <benchmark> <variant> <defines...>
+build() {
+    name=$1
+    variant=$2
+    shift 2
+    $CXX "$@" $SOURCES test/bench/$name.cpp -o $OUT/$name-$variant
+}
+
+append() {
+    echo "AppendBench: 1 MiB in 100 byte records, sync every 40 records"
+    for slots in 1 2 4; do
+        build AppendBench $slots -DFAT_DEVICE_IMAGE -DFAT_CACHE_STATS -DFAT_CACHE_SLOTS=$slots
+    done
+    for geometry in "64 32 1" "300 32 8"; do
+        echo "  FAT32, $(echo $geometry | cut -d' ' -f3) blocks per cluster"
+        for slots in 1 2 4; do
+            printf '    '
+            $OUT/AppendBench-$slots $OUT/bench.img $geometry
+        done
+    done
+}
+
+mirror() {
+    echo "AppendBench: immediate against deferred FAT mirror, FAT32, 1 block per cluster"
+    for slots in 1 4; do
+        build AppendBench $slots -DFAT_DEVICE_IMAGE -DFAT_CACHE_STATS -DFAT_CACHE_SLOTS=$slots
+        for sync in 40 0; do
+            for deferred in 0 1; do
+                printf '    sync every %2s, deferred %s: ' $sync $deferred
+                $OUT/AppendBench-$slots $OUT/bench.img 64 32 1 $sync $deferred
+            done
+        done
+    done
+}
+
+full() {
+    echo "FullBench: 64 MB FAT32, 1 block per cluster, 20 holes near the end"
+    build FullBench default -DFAT_DEVICE_IMAGE
+    $OUT/FullBench-default $OUT/bench.img 64 32 1 60000 | sed 's/^/    /'
+}
+
+frag() {
+    echo "FragBench: 64 MB FAT32, 1 block per cluster, RamDisk, every other cluster free"
+    build FragBench ram -DFAT_DEVICE_RAM
+    $OUT/FragBench-ram $OUT/bench.img 64 32 1 | sed 's/^/    /'
+}
+
+seek() {
+    echo "SeekBench: 5000 random 100 byte reads from a 4 MB file in 8 fragments"
+    for slots in 0 4 8; do
+        build SeekBench $slots -DFAT_DEVICE_IMAGE -DFILE_EXTENT_SLOTS=$slots
+    done
+    for geometry in "64 32 1" "300 32 8"; do
+        echo "  FAT32, $(echo $geometry | cut -d' ' -f3) blocks per cluster"
+        for slots in 0 4 8; do
+            printf '    '
+            $OUT/SeekBench-$slots $OUT/bench.img $geometry
+        done
+    done
+}
+
+prealloc() {
+    echo "PreallocBench: 1 MB appended in 4 KB writes to a 10 KB file, FAT32, 1 block per cluster"
+    build PreallocBench default -DFAT_DEVICE_IMAGE
+    for preallocate in 0 1; do
+        printf '    '
+        $OUT/PreallocBench-default $OUT/bench.img 64 32 1 $preallocate
+    done
+}
+
+au() {
+    echo "AuBench: 8 MB in 1 MB files after freeing holes, FAT32, 1 block per cluster, 4 open AUs of 512 KB"
+    build AuBench default -DFAT_DEVICE_IMAGE
+    for align in 0 1; do
+        printf '    '
+        $OUT/AuBench-default $OUT/bench.img 64 32 1 1024 $align
+    done
+}
+
+spi() {
+    echo "SpiBench: one 512 byte block through the fake SPI registers"
+    $CXX -Wno-attributes -DF_CPU=16000000 -DSIM_SPI_POLLS src/SPI.cpp test/bench/SpiBench.cpp -o $OUT/SpiBench
+    $OUT/SpiBench | sed 's/^/    /'
+}
+
+millis() {
+    echo "MillisBench: SD card busy waits against SimCard, 1 byte per us"
+    for variant in tick tickless; do
+        defines="-Wno-attributes -DF_CPU=16000000"
+        [ $variant = tickless ] && defines="$defines -DMILLIS_TICKLESS"
+        $CXX $defines src/SDCard.cpp src/SPI.cpp src/Millis.cpp test/SimCard.cpp test/bench/MillisBench.cpp -o $OUT/MillisBench-$variant
+        echo "  $variant"
+        $OUT/MillisBench-$variant | sed 's/^/    /'
+    done
+}
+
+getfat() {
+    echo "GetFatBench: FAT.o text size and get_fat() time at -Os, RamDisk"
+    for variant in both FAT16 FAT32; do
+        defines="-Os -DFAT_DEVICE_RAM"
+        [ $variant != both ] && defines="$defines -DFAT_ONLY_$variant"
+        $CXX $defines -c src/FAT.cpp -o $OUT/FAT-$variant.o
+        build GetFatBench $variant $defines
+        echo "  $variant: FAT.o text $(size $OUT/FAT-$variant.o | awk 'NR == 2 { print $1 }') bytes"
+        for geometry in "32 16 4" "64 32 1"; do
+            printf '    '
+            $OUT/GetFatBench-$variant $OUT/bench.img $geometry
+        done
+    done
+}
+
+index() {
+    echo "IndexBench: 2000 entry directory, FAT32, 8 blocks per cluster"
+    build IndexBench default -DFAT_DEVICE_IMAGE
+    for entries in 0 2200; do
+        printf '    '
+        $OUT/IndexBench-default $OUT/bench.img 300 32 8 $entries
+    done
+}
+
+iter() {
+    echo "IterBench: 2000 entry directory, FAT32, 8 blocks per cluster"
+    build IterBench default -DFAT_DEVICE_IMAGE
+    $OUT/IterBench-default $OUT/bench.img 300 32 8 | sed 's/^/    /'
+}
+
+view() {
+    echo "ViewBench: line parser over a log, FAT32, 8 blocks per cluster"
+    build ViewBench default -DFAT_DEVICE_IMAGE
+    $OUT/ViewBench-default $OUT/bench.img 300 32 8 | sed 's/^/    /'
+}
+
+for bench in ${*:-append mirror full frag seek prealloc au spi millis getfat index iter view}; do
+    $bench
+done
+rm -f $OUT/bench.img
@@ -0,0 +1,41 @@
+/**
+ * @file atomic.h
+ * 
+ * @author
+ * Angelo Elias Dalzotto (150633@upf.br)
+ * GEPID - Grupo de Pesquisa em Cultura Digital (http://gepid.upf.br/)
+ * Universidade de Passo Fundo (http://www.upf.br/)
+ * 
+ * @copyright
+ * Copyright (C) 2018 by Angelo Elias Dalzotto
+ * 
+ * @brief Host stand-in for util/atomic.h.
+ * 
+ * This Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the Arduino Sd2Card Library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SIM_UTIL_ATOMIC_H_
+#define _SIM_UTIL_ATOMIC_H_
+
+#include <stdint.h>
+
+/** Atomic blocks entered, counted for the clock benchmark. */
+extern uint32_t sim_atomic_blocks;
+
+// the simulation runs interrupts synchronously, nothing to block
+#define ATOMIC_BLOCK(type) for (uint8_t atomic_once = (sim_atomic_blocks++, 1); atomic_once; atomic_once = 0)
+#define ATOMIC_FORCEON
+
+#endif /* _SIM_UTIL_ATOMIC_H_ */